@@ -9,18 +9,26 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
-    itemwidget.cpp \
+    filelistmodel.cpp \
+    filetree.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    rangetransfer.cpp \
+    transferdialog.cpp \
+    transfermanager.cpp
 
 HEADERS += \
-    itemwidget.h \
+    filelistmodel.h \
+    filetree.h \
     mainwindow.h \
+    rangetransfer.h \
+    transferdialog.h \
+    transfermanager.h \
     ../FileUtils/utils.h
 
 FORMS += \
-    itemwidget.ui \
-    mainwindow.ui
+    mainwindow.ui \
+    transferdialog.ui
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -0,0 +1,100 @@
+#include "filelistmodel.h"
+
+#include <QPainter>
+#include <QApplication>
+
+static const int ROW_WIDTH = 480;
+static const int ROW_HEIGHT = 48;
+static const int ICON_SIZE = 24;
+static const int ICON_MARGIN = 12;
+static const int TEXT_LEFT = 50;
+static const int TEXT_POINT_SIZE = 11;
+
+FileListModel::FileListModel(QObject* parent) : QAbstractListModel(parent), folder(nullptr) {
+
+}
+
+void FileListModel::setFolder(const FileNode* folder) {
+    beginResetModel();
+    this->folder = folder;
+    endResetModel();
+}
+
+const FileNode* FileListModel::node(const QModelIndex& index) const {
+    if (!folder || !index.isValid() || index.row() >= folder->children.size()) {
+        return nullptr;
+    }
+
+    return folder->children.at(index.row());
+}
+
+int FileListModel::rowCount(const QModelIndex& parent) const {
+    if (parent.isValid() || !folder) {
+        return 0;
+    }
+
+    return folder->children.size();
+}
+
+QVariant FileListModel::data(const QModelIndex& index, int role) const {
+    const FileNode* child = node(index);
+    if (!child) {
+        return QVariant();
+    }
+
+    switch (role) {
+        case Qt::DisplayRole:
+            return child->name;
+
+        case Qt::ToolTipRole:
+            return child->path;
+
+        default:
+            return QVariant();
+    }
+}
+
+FileItemDelegate::FileItemDelegate(QObject* parent) : QStyledItemDelegate(parent) {
+    document = QPixmap(":images/document.png").scaled(ICON_SIZE, ICON_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    folder = QPixmap(":images/folder.png").scaled(ICON_SIZE, ICON_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    folderEmpty = QPixmap(":images/folder_empty.png").scaled(ICON_SIZE, ICON_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+}
+
+void FileItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const {
+    const FileListModel* model = qobject_cast<const FileListModel*>(index.model());
+    const FileNode* node = model ? model->node(index) : nullptr;
+    if (!node) {
+        return;
+    }
+
+    // Selection and hover come from the style, so the view looks as it did with widgets.
+    QStyleOptionViewItem background = option;
+    initStyleOption(&background, index);
+    background.text = QString();
+    const QWidget* widget = option.widget;
+    QStyle* style = widget ? widget->style() : QApplication::style();
+    style->drawPrimitive(QStyle::PE_PanelItemViewItem, &background, painter, widget);
+
+    // A folder that was never listed shows as empty, as it always has.
+    const QPixmap& icon = !node->dir ? document : (node->children.isEmpty() ? folderEmpty : folder);
+    QRect rect = option.rect;
+    painter->drawPixmap(rect.left() + ICON_MARGIN, rect.top() + (rect.height() - ICON_SIZE) / 2, icon);
+
+    painter->save();
+    QFont font = option.font;
+    font.setPointSize(TEXT_POINT_SIZE);
+    painter->setFont(font);
+    painter->setPen(option.palette.color(option.state & QStyle::State_Selected ? QPalette::HighlightedText : QPalette::Text));
+
+    QRect textRect(rect.left() + TEXT_LEFT, rect.top(), rect.width() - TEXT_LEFT - ICON_MARGIN, rect.height());
+    QString text = QFontMetrics(font).elidedText(node->name, Qt::ElideMiddle, textRect.width());
+    painter->drawText(textRect, Qt::AlignLeft | Qt::AlignVCenter, text);
+    painter->restore();
+}
+
+QSize FileItemDelegate::sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const {
+    Q_UNUSED(option);
+    Q_UNUSED(index);
+
+    return QSize(ROW_WIDTH, ROW_HEIGHT);
+}
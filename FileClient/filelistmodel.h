@@ -0,0 +1,45 @@
+#ifndef FILELISTMODEL_H
+#define FILELISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QStyledItemDelegate>
+#include <QPixmap>
+
+#include "filetree.h"
+
+// The children of one folder of the FileTree, read straight from its nodes. The model
+// holds no copy, so it has to be pointed at the folder again whenever the tree changes.
+class FileListModel : public QAbstractListModel {
+    Q_OBJECT
+
+public:
+    explicit FileListModel(QObject* parent = nullptr);
+
+    void setFolder(const FileNode* folder);
+    const FileNode* node(const QModelIndex& index) const;
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+private:
+    const FileNode* folder;
+};
+
+// Paints a row as the old ItemWidget looked, for the rows in view only.
+class FileItemDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+
+public:
+    explicit FileItemDelegate(QObject* parent = nullptr);
+
+    void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+    QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+
+private:
+    // Decoded and scaled once, rows only blit them.
+    QPixmap document;
+    QPixmap folder;
+    QPixmap folderEmpty;
+};
+
+#endif // !FILELISTMODEL_H
@@ -0,0 +1,177 @@
+#include "filetree.h"
+
+#include <QJsonArray>
+#include <QJsonValue>
+
+FileTree::FileTree() : rootNode(nullptr) {
+
+}
+
+FileTree::~FileTree() {
+    clear();
+}
+
+void FileTree::clear() {
+    release(rootNode);
+    rootNode = nullptr;
+    nodes.clear();
+}
+
+FileNode* FileTree::root() const {
+    return rootNode;
+}
+
+FileNode* FileTree::find(const QString& path) const {
+    return nodes.value(path, nullptr);
+}
+
+bool FileTree::setListing(const QJsonObject& folder, bool append) {
+    QString path = folder.value("path").toString();
+    FileNode* node = find(path);
+
+    // The first listing of the account's own folder starts the tree.
+    if (!node) {
+        if (rootNode || append) {
+            return false;
+        }
+        QJsonObject object = folder;
+        object.remove("children");
+        rootNode = node = create(object, nullptr);
+    }
+
+    if (!append) {
+        foreach (FileNode* child, node->children) {
+            release(child);
+        }
+        node->children.clear();
+    }
+
+    // Pages come in the server's order, each one follows the last.
+    foreach (const QJsonValue& value, folder.value("children").toArray()) {
+        QJsonObject object = value.toObject();
+        FileNode* old = find(object.value("path").toString());
+        if (old && old->parent == node) {
+            node->children.removeOne(old);
+            release(old);
+        }
+        node->children.append(create(object, node));
+    }
+    node->listed = true;
+
+    return true;
+}
+
+bool FileTree::apply(const QJsonObject& delta) {
+    QString parentPath = delta.value("parent").toString();
+    FileNode* parent = find(parentPath);
+    if (!parent) {
+        // Nothing cached below a folder that was never opened.
+        return underUnlisted(parentPath);
+    }
+
+    if (!parent->listed) {
+        return true;
+    }
+
+    QJsonObject added = delta.value("node").toObject();
+    bool add = delta.value("op").toString() == "add";
+    QString name = add ? added.value("name").toString() : delta.value("name").toString();
+    for (int i = 0; i < parent->children.size(); i++) {
+        if (parent->children.at(i)->name == name) {
+            release(parent->children.takeAt(i));
+            break;
+        }
+    }
+
+    if (add) {
+        insert(parent, create(added, parent));
+    }
+
+    return true;
+}
+
+QJsonObject FileTree::toJson(const FileNode* node) {
+    QJsonObject object;
+    object.insert("name", node->name);
+    object.insert("path", node->path);
+    object.insert("modified", node->modified);
+
+    if (node->dir) {
+        object.insert("type", "dir");
+    } else {
+        object.insert("type", "file");
+        object.insert("size", node->size);
+    }
+
+    return object;
+}
+
+FileNode* FileTree::create(const QJsonObject& object, FileNode* parent) {
+    FileNode* node = new FileNode;
+    node->name = object.value("name").toString();
+    node->path = object.value("path").toString();
+    node->dir = object.value("type").toString() == "dir";
+    node->size = object.value("size").toVariant().toLongLong();
+    node->modified = object.value("modified").toVariant().toLongLong();
+    node->listed = false;
+    node->parent = parent;
+    nodes.insert(node->path, node);
+
+    // A node may come with its children already listed, as the account's root does.
+    if (node->dir && object.contains("children")) {
+        foreach (const QJsonValue& value, object.value("children").toArray()) {
+            node->children.append(create(value.toObject(), node));
+        }
+        node->listed = true;
+    }
+
+    return node;
+}
+
+void FileTree::insert(FileNode* parent, FileNode* child) {
+    // Keep the server's order: folders first, then by name.
+    int index = 0;
+    while (index < parent->children.size()) {
+        const FileNode* sibling = parent->children.at(index);
+        if (child->dir && !sibling->dir) {
+            break;
+        }
+        if (child->dir == sibling->dir && sibling->name > child->name) {
+            break;
+        }
+        index++;
+    }
+    parent->children.insert(index, child);
+}
+
+void FileTree::release(FileNode* node) {
+    if (!node) {
+        return;
+    }
+
+    foreach (FileNode* child, node->children) {
+        release(child);
+    }
+
+    // Only unindexed if the path still points here, a replacement may already have taken it.
+    if (nodes.value(node->path) == node) {
+        nodes.remove(node->path);
+    }
+    delete node;
+}
+
+bool FileTree::underUnlisted(const QString& path) const {
+    QString ancestor = path;
+    forever {
+        int index = qMax(ancestor.lastIndexOf('/'), ancestor.lastIndexOf('\\'));
+        if (index <= 0) {
+            return false;
+        }
+
+        ancestor = ancestor.left(index);
+        const FileNode* node = find(ancestor);
+        if (node) {
+            return node->dir && !node->listed;
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef FILETREE_H
+#define FILETREE_H
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QJsonObject>
+
+struct FileNode {
+    QString name;
+    QString path;
+    bool dir;
+    qint64 size;
+    qint64 modified;
+    // Folders come without children until they are opened and listed.
+    bool listed;
+    FileNode* parent;
+    QList<FileNode*> children;
+};
+
+// The account as far as the client has seen it. Built from the server's listings and
+// patched in place by its deltas, every node is indexed by its path.
+class FileTree {
+public:
+    FileTree();
+    ~FileTree();
+
+    void clear();
+    FileNode* root() const;
+    FileNode* find(const QString& path) const;
+
+    bool setListing(const QJsonObject& folder, bool append);
+    bool apply(const QJsonObject& delta);
+
+    static QJsonObject toJson(const FileNode* node);
+
+private:
+    FileNode* create(const QJsonObject& object, FileNode* parent);
+    void insert(FileNode* parent, FileNode* child);
+    void release(FileNode* node);
+    bool underUnlisted(const QString& path) const;
+
+    FileNode* rootNode;
+    QHash<QString, FileNode*> nodes;
+};
+
+#endif // !FILETREE_H
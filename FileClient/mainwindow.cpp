@@ -4,19 +4,68 @@
 
 #include <QDebug>
 #include <QDir>
-#include <QQueue>
+
+#include <cstring>
 #include <QMessageBox>
 #include <QInputDialog>
-#include <QListWidgetItem>
 #include <QJsonValue>
 #include <QFileDialog>
 #include <QStandardPaths>
-
-#include "itemwidget.h"
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QStatusBar>
+#include <QDirIterator>
 
 #include "../FileUtils/utils.h"
 
-MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) , ui(new Ui::MainWindow) {
+static const int PAGE_SIZE = 200;
+static const int MAX_FRAME_SIZE = 64 * 1024 * 1024;
+static const qint64 UPLOAD_CHUNK_SIZE = 64 * 1024;
+static const int UPLOAD_CHUNK_HEADER_SIZE = 64;
+static const qint64 DELTA_MIN_SIZE = 64 * 1024;
+static const int DELTA_READ_SIZE = 1024 * 1024;
+static const int DELTA_FRAME_SIZE = 256 * 1024;
+static const int SIGNATURE_HEADER_SIZE = 16;
+// Files from this size on move over several connections, each with its own range.
+static const qint64 PARALLEL_MIN_SIZE = 16 * 1024 * 1024;
+static const int PARALLEL_STREAMS = 4;
+static const int PROGRESS_INTERVAL = 250;
+// Upload data read ahead into the socket, beyond this the next chunk waits for bytesWritten().
+static const qint64 UPLOAD_WINDOW = 16 * UPLOAD_CHUNK_SIZE;
+
+// Downloads are written to a part file next to the destination, which is only replaced once all of it is in.
+static QString partPath(const QString& filePath) {
+    return filePath + ".part";
+}
+
+// The version of the remote file a part file holds a prefix of, its size and modification time.
+static QString versionPath(const QString& filePath) {
+    return partPath(filePath) + ".id";
+}
+
+static QByteArray remoteVersion(const QJsonObject& object) {
+    return QString("%1;%2").arg(object.value("size").toVariant().toLongLong()).arg(object.value("modified").toVariant().toLongLong()).toUtf8();
+}
+
+static bool writeVersion(const QString& filePath, const QByteArray& version) {
+    QFile file(versionPath(filePath));
+    return file.open(QIODevice::WriteOnly) && file.write(version) == version.size();
+}
+
+static bool commitPart(const QString& filePath) {
+    if (QFileInfo::exists(filePath) && !QFile::remove(filePath)) {
+        return false;
+    }
+
+    if (!QFile::rename(partPath(filePath), filePath)) {
+        return false;
+    }
+
+    QFile::remove(versionPath(filePath));
+    return true;
+}
+
+MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) , ui(new Ui::MainWindow), transferDialog(nullptr), nextJob(1), uploadFile(nullptr), uploadSession(0), uploadIndex(-1), uploadCompress(false), uploadJob(0), delta(nullptr), compression(false), nextRequestId(1), inputPos(0) {
     ui->setupUi(this);
 
     setWindowFlags(windowFlags() | Qt::MSWindowsFixedSizeDialogHint);
@@ -25,118 +74,80 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) , ui(new Ui::MainW
 
     // ui->lvLogs->setModel(model);
 
+    // Rows are all the same height, so the view lays out and paints only what is in view.
+    listModel = new FileListModel(this);
+    ui->listView->setModel(listModel);
+    ui->listView->setItemDelegate(new FileItemDelegate(ui->listView));
+    ui->listView->setUniformItemSizes(true);
+    ui->listView->setSelectionMode(QAbstractItemView::ExtendedSelection);
+
+    // Bulk transfers run in the background, each on a connection of its own.
+    transfers = new TransferManager(this);
+    connect(transfers, &TransferManager::treeChanged, this, &MainWindow::processUpdateData);
+    connect(transfers, &TransferManager::itemFinished, this, [this](const QString& message) {
+        displayMessage(message);
+        statusBar()->showMessage(message, 5000);
+    });
+
     socket = new QTcpSocket(this);
 
     connect(this, &MainWindow::newMessage, this, &MainWindow::displayMessage);
     connect(socket, &QTcpSocket::readyRead, this, &MainWindow::onReadyRead);
     connect(socket, &QTcpSocket::disconnected, this, &MainWindow::onSocketDisconnected);
     connect(socket, &QAbstractSocket::errorOccurred, this, &MainWindow::onErrorOccurred);
+    connect(socket, &QTcpSocket::bytesWritten, this, &MainWindow::onBytesWritten);
+
+    btnCancel = new QPushButton("Cancel upload", this);
+    btnCancel->setVisible(false);
+    statusBar()->addPermanentWidget(btnCancel);
+    connect(btnCancel, &QPushButton::clicked, this, &MainWindow::cancelUpload);
 
     socket->connectToHost(QHostAddress::LocalHost, 2209);
     if (socket->waitForConnected()) {
         qDebug() << "Connected to Server";
+        sendRequest(RequestHello, COMPRESSION_CODEC);
     } else {
         QMessageBox::critical(this, "QTcpClient", QString("The following error occurred: %1.").arg(socket->errorString()));
         exit(EXIT_FAILURE);
     }
 
     connect(ui->btnSignIn, &QPushButton::clicked, this, [this]() {
-        if(socket) {
-            if(socket->isOpen()) {
-                QString username = ui->edtUsername->text();
-                QString password = ui->edtPassword->text();
-                if (username.isEmpty() || password.isEmpty()) {
-                    QMessageBox::warning(this, "Warning", "Please fill all required fields");
-                    return;
-                }
-
-                QDataStream socketStream(socket);
-                socketStream.setVersion(QDataStream::Qt_5_15);
-
-                Request type = Request::RequestSignIn;
-                QByteArray typeArray = QByteArray::number(type);
-                typeArray.resize(8);
-
-                QString str = username + ";" + password;
-                QByteArray byteArray = str.toUtf8();
-                byteArray.prepend(typeArray);
-
-                socketStream << byteArray;
-            } else {
-                QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
-            }
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Not connected");
+        QString username = ui->edtUsername->text();
+        QString password = ui->edtPassword->text();
+        if (username.isEmpty() || password.isEmpty()) {
+            QMessageBox::warning(this, "Warning", "Please fill all required fields");
+            return;
         }
+
+        QString str = username + ";" + password;
+        sendRequest(RequestSignIn, str.toUtf8());
     });
 
     connect(ui->btnSignUp, &QPushButton::clicked, this, [this]() {
-        if(socket) {
-            if(socket->isOpen()) {
-                QString username = ui->edtUsername->text();
-                QString password = ui->edtPassword->text();
-                if (username.isEmpty() || password.isEmpty()) {
-                    QMessageBox::warning(this, "Warning", "Please fill all required fields");
-                    return;
-                }
-
-                QDataStream socketStream(socket);
-                socketStream.setVersion(QDataStream::Qt_5_15);
-
-                Request type = Request::RequestSignUp;
-                QByteArray typeArray = QByteArray::number(type);
-                typeArray.resize(8);
-
-                QString str = username + ";" + password;
-                QByteArray byteArray = str.toUtf8();
-                byteArray.prepend(typeArray);
-
-                socketStream << byteArray;
-            } else {
-                QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
-            }
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Not connected");
+        QString username = ui->edtUsername->text();
+        QString password = ui->edtPassword->text();
+        if (username.isEmpty() || password.isEmpty()) {
+            QMessageBox::warning(this, "Warning", "Please fill all required fields");
+            return;
         }
+
+        QString str = username + ";" + password;
+        sendRequest(RequestSignUp, str.toUtf8());
     });
 
     connect(ui->btnSignOut, &QPushButton::clicked, this, [this]() {
-        if(socket) {
-            if(socket->isOpen()) {
-                QString str = currentUser;
-
-                QDataStream socketStream(socket);
-                socketStream.setVersion(QDataStream::Qt_5_15);
-
-                Request type = Request::RequestSignOut;
-                QByteArray typeArray = QByteArray::number(type);
-                typeArray.resize(8);
-
-                QByteArray byteArray = str.toUtf8();
-                byteArray.prepend(typeArray);
-
-                socketStream << byteArray;
-            } else {
-                QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
-            }
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Not connected");
-        }
+        sendRequest(RequestSignOut, currentUser.toUtf8());
     });
 
     connect(ui->btnRefresh, &QPushButton::clicked, this, [this]() {
+        currentPath = QString();
         sendGetData();
     });
 
     connect(ui->btnDelete, &QPushButton::clicked, this, [this]() {
-        QListWidgetItem* item = ui->listWidget->currentItem();
-        if (item) {
-            for (int i = 0; i < ui->listWidget->count(); i++) {
-                if (ui->listWidget->item(i) == item) {
-                    sendDelete(items[i]->getData());
-                    break;
-                }
-            }
+        const FileNode* node = listModel->node(ui->listView->currentIndex());
+        if (node) {
+            sendDelete(FileTree::toJson(node));
         } else {
             displayMessage("Delete: Please select an item");
             QMessageBox::information(this, "Information", "Please select an item");
@@ -144,14 +155,24 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) , ui(new Ui::MainW
     });
 
     connect(ui->btnDownload, &QPushButton::clicked, this, [this]() {
-        QListWidgetItem* item = ui->listWidget->currentItem();
-        if (item) {
-            for (int i = 0; i < ui->listWidget->count(); i++) {
-                if (ui->listWidget->item(i) == item) {
-                    sendDownload(items[i]->getData());
-                    break;
+        QModelIndexList selected = ui->listView->selectionModel()->selectedIndexes();
+        const FileNode* node = listModel->node(ui->listView->currentIndex());
+        if (selected.size() > 1) {
+            // Several files go to one folder through the transfer queue.
+            QString dirPath = QFileDialog::getExistingDirectory(this, "Save Files", QDir::currentPath());
+            if (dirPath.isEmpty()) {
+                return;
+            }
+
+            foreach (const QModelIndex& index, selected) {
+                const FileNode* file = listModel->node(index);
+                if (file && !file->dir) {
+                    transfers->addDownload(FileTree::toJson(file), QDir(dirPath).filePath(file->name));
                 }
             }
+            showTransfers();
+        } else if (node) {
+            sendDownload(FileTree::toJson(node));
         } else {
             displayMessage("Download: Please select a file");
             QMessageBox::information(this, "Information", "Please select a file");
@@ -159,6 +180,8 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) , ui(new Ui::MainW
     });
 
     connect(ui->btnUpload, &QPushButton::clicked, this, &MainWindow::sendFile);
+    connect(ui->btnUploadFolder, &QPushButton::clicked, this, &MainWindow::sendFolder);
+    connect(ui->btnTransfers, &QPushButton::clicked, this, &MainWindow::showTransfers);
 
     connect(ui->btnCreateFolder, &QPushButton::clicked, this, [this]() {
         bool ok;
@@ -170,71 +193,32 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) , ui(new Ui::MainW
             }
         } while (ok && name.isEmpty());
 
-        if(socket) {
-            if(socket->isOpen()) {
-                QString str = this->current.value("path").toString() + ";" + name;
-
-                QDataStream socketStream(socket);
-                socketStream.setVersion(QDataStream::Qt_5_15);
-
-                Request type = Request::RequestAddFolder;
-                QByteArray typeArray = QByteArray::number(type);
-                typeArray.resize(8);
-
-                QByteArray byteArray = str.toUtf8();
-                byteArray.prepend(typeArray);
-
-                socketStream << byteArray;
-            } else {
-                QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
-            }
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Not connected");
-        }
+        QString str = currentPath + ";" + name;
+        sendRequest(RequestAddFolder, str.toUtf8());
     });
 
     connect(ui->btnBack, &QPushButton::clicked, this, [this]() {
-        QString path = current.value("path").toString();
-        QString parentPath;
-        if (path.lastIndexOf(QDir::separator()) != -1) {
-            parentPath = path.mid(0, path.lastIndexOf(QDir::separator()));
-        } else if (path.lastIndexOf("/") != -1) {
-            parentPath = path.mid(0, path.lastIndexOf("/"));
-        } else if (path.lastIndexOf("\\") != -1) {
-            parentPath = path.mid(0, path.lastIndexOf("\\"));
-        } else {
+        FileNode* folder = tree.find(currentPath);
+        if (!folder || !folder->parent) {
             return;
         }
 
-        QQueue<QJsonObject> queue;
-        queue.enqueue(jsonData);
-        while (!queue.isEmpty()) {
-            QJsonObject object = queue.dequeue();
-            if (object.value("path").toString() == parentPath) {
-                updateListWidget(object);
-                break;
-            }
+        updateListWidget(folder->parent);
+        displayMessage("Back to " + currentPath);
+    });
 
-            QJsonArray children = object.value("children").toArray();
-            for (int i = 0; i < children.count(); i++) {
-                QJsonObject child = children.at(i).toObject();
-                if (child.value("type").toString() == "dir") {
-                    queue.enqueue(child);
-                }
-            }
+    connect(ui->listView, &QListView::doubleClicked, this, [this](const QModelIndex& index) {
+        const FileNode* node = listModel->node(index);
+        if (!node) {
+            return;
         }
 
-        displayMessage("Back to " + parentPath);
-    });
-
-    connect(ui->listWidget, &QListWidget::itemDoubleClicked, this, [this](QListWidgetItem* item) {
-        for (int i = 0; i < ui->listWidget->count(); i++) {
-            if (ui->listWidget->item(i) == item) {
-                displayMessage(QString("Double click on ") + items[i]->getData().value("path").toString());
-                if (items[i]->getData().value("type").toString() == "dir") {
-                    updateListWidget(items[i]->getData());
-                }
-                break;
+        displayMessage(QString("Double click on ") + node->path);
+        if (node->dir) {
+            // Folders are listed the first time they are opened.
+            updateListWidget(node);
+            if (!node->listed) {
+                sendGetData(node->path);
             }
         }
     });
@@ -246,6 +230,13 @@ MainWindow::~MainWindow() {
         socket->deleteLater();
     }
 
+    foreach (const PendingDownload& download, downloads) {
+        download.file->close();
+        delete download.file;
+    }
+
+    closeUpload();
+
     model->deleteLater();
 
     delete ui;
@@ -265,48 +256,55 @@ void MainWindow::displayError(const QString& msg) {
     QMessageBox::critical(this, "Error", msg);
 }
 
-void MainWindow::updateListWidget(const QJsonObject& data) {
-    current = data;
+void MainWindow::updateListWidget(const FileNode* folder) {
+    currentPath = folder ? folder->path : QString();
+    listModel->setFolder(folder);
 
-    items.clear();
-
-    ui->listWidget->clear();
-
-    QString path = data.value("path").toString().replace("/", " > ").replace("\\", " > ");
+    QString path = QString(currentPath).replace("/", " > ").replace("\\", " > ");
     ui->lbPath->setText(QString("> ") + path);
-    ui->btnBack->setEnabled(path.contains(" > "));
-
-    QJsonArray children = data.value("children").toArray();
-    for (int i = 0; i < children.count(); i++) {
-        auto widget = new ItemWidget(this);
-        widget->setData(children.at(i).toObject());
-
-        items.append(widget);
-
-        auto item = new QListWidgetItem();
-        item->setSizeHint(QSize(480, 48));
-
-        ui->listWidget->addItem(item);
-        ui->listWidget->setItemWidget(item, widget);
-    }
+    ui->btnBack->setEnabled(folder && folder->parent);
 }
 
 void MainWindow::onReadyRead() {
-    QByteArray buffer;
+    // Every complete frame is handled before returning, the socket is only read again once
+    // the buffer holds no complete frame.
+    while (socket) {
+        int available = input.size() - inputPos;
+        if (available >= FRAME_HEADER_SIZE) {
+            FrameHeader header;
+            if (!readFrameHeader(input.constData() + inputPos, header) || header.length > quint64(MAX_FRAME_SIZE)) {
+                displayMessage("onReadyRead: Invalid frame header");
+                socket->disconnectFromHost();
+                return;
+            }
 
-    QDataStream socketStream(socket);
-    socketStream.setVersion(QDataStream::Qt_5_15);
+            int frameSize = FRAME_HEADER_SIZE + int(header.length);
+            if (available >= frameSize) {
+                // Taken out before it is handled, a handler may open a dialog and re-enter here.
+                QByteArray payload = input.mid(inputPos + FRAME_HEADER_SIZE, int(header.length));
+                inputPos += frameSize;
+                if ((header.flags & FRAME_COMPRESSED) && !uncompressPayload(payload, MAX_FRAME_SIZE, payload)) {
+                    displayMessage("onReadyRead: Invalid compressed data");
+                    socket->disconnectFromHost();
+                    return;
+                }
+                handleData(header.type, header.requestId, payload);
+                continue;
+            }
+        }
 
-    socketStream.startTransaction();
-    socketStream >> buffer;
+        if (socket->bytesAvailable() == 0) {
+            if (available > 0) {
+                QString message = QString("%1 :: Waiting for more data to come..").arg(socket->socketDescriptor());
+                emit newMessage(message);
+            }
+            return;
+        }
 
-    if(!socketStream.commitTransaction()) {
-        QString message = QString("%1 :: Waiting for more data to come..").arg(socket->socketDescriptor());
-        emit newMessage(message);
-        return;
+        input.remove(0, inputPos);
+        inputPos = 0;
+        input.append(socket->readAll());
     }
-
-    handleData(buffer);
 }
 
 void MainWindow::onSocketDisconnected() {
@@ -335,28 +333,18 @@ void MainWindow::onErrorOccurred(QAbstractSocket::SocketError error) {
     }
 }
 
-void MainWindow::sendGetData() {
-    if(socket) {
-        if(socket->isOpen()) {
-            QString str = currentUser;
-
-            QDataStream socketStream(socket);
-            socketStream.setVersion(QDataStream::Qt_5_15);
-
-            Request type = Request::RequestGetData;
-            QByteArray typeArray = QByteArray::number(type);
-            typeArray.resize(8);
-
-            QByteArray byteArray = str.toUtf8();
-            byteArray.prepend(typeArray);
-
-            socketStream << byteArray;
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
-        }
-    } else {
-        QMessageBox::critical(this, "QTcpClient", "Not connected");
+void MainWindow::sendGetData(const QString& path, const QString& cursor) {
+    QJsonObject object;
+    object.insert("path", path.isEmpty() ? currentUser : path);
+    object.insert("depth", 1);
+    object.insert("limit", PAGE_SIZE);
+    if (!cursor.isEmpty()) {
+        object.insert("cursor", cursor);
     }
+
+    QJsonDocument jsonDoc;
+    jsonDoc.setObject(object);
+    sendRequest(RequestGetData, jsonDoc.toJson(QJsonDocument::Compact));
 }
 
 void MainWindow::sendDelete(QJsonObject object) {
@@ -371,25 +359,7 @@ void MainWindow::sendDelete(QJsonObject object) {
     QString data = jsonDoc.toJson(QJsonDocument::Compact);
     displayMessage(QString("Delete ") + data);
 
-    if(socket) {
-        if(socket->isOpen()) {
-            QDataStream socketStream(socket);
-            socketStream.setVersion(QDataStream::Qt_5_15);
-
-            Request type = Request::RequestDelete;
-            QByteArray typeArray = QByteArray::number(type);
-            typeArray.resize(8);
-
-            QByteArray byteArray = data.toUtf8();
-            byteArray.prepend(typeArray);
-
-            socketStream << byteArray;
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
-        }
-    } else {
-        QMessageBox::critical(this, "QTcpClient", "Not connected");
-    }
+    sendRequest(RequestDelete, data.toUtf8());
 }
 
 void MainWindow::sendDownload(QJsonObject object) {
@@ -399,84 +369,191 @@ void MainWindow::sendDownload(QJsonObject object) {
         return;
     }
 
-    QJsonDocument jsonDoc;
-    jsonDoc.setObject(object);
-    QString data = jsonDoc.toJson(QJsonDocument::Compact);
-    displayMessage(QString("Download ") + data);
+    QString filename = object.value("name").toString();
+    qint64 size = object.value("size").toVariant().toLongLong();
 
-    if(socket) {
-        if(socket->isOpen()) {
-            QDataStream socketStream(socket);
-            socketStream.setVersion(QDataStream::Qt_5_15);
+    QString filePath = QFileDialog::getSaveFileName(this, tr("Save File"), QDir::currentPath() + QDir::separator() + filename);
+    displayMessage("Download save on " + filePath);
+    if (filePath.isEmpty()) {
+        QMessageBox::information(this,"Download", QString("File %1 discarded.").arg(filename));
+        return;
+    }
 
-            Request type = Request::RequestDownload;
-            QByteArray typeArray = QByteArray::number(type);
-            typeArray.resize(8);
+    bool busy = false;
+    foreach (const PendingDownload& download, downloads) {
+        busy = busy || download.filePath == filePath;
+    }
+    foreach (const ParallelJob& parallel, parallelJobs) {
+        busy = busy || parallel.localPath == filePath;
+    }
+    if (busy) {
+        QMessageBox::information(this, "Download", QString("%1 is already being downloaded").arg(filePath));
+        return;
+    }
 
-            QByteArray byteArray = data.toUtf8();
-            byteArray.prepend(typeArray);
+    // A part file left behind is an interrupted earlier download, it is only resumed where the
+    // remote file is still the version it was taken from.
+    QIODevice::OpenMode mode = QIODevice::WriteOnly;
+    QFileInfo info(partPath(filePath));
+    QFile versionFile(versionPath(filePath));
+    bool sameVersion = versionFile.open(QIODevice::ReadOnly) && versionFile.readAll() == remoteVersion(object);
+    versionFile.close();
+    if (sameVersion && info.exists() && info.size() > 0 && info.size() < size) {
+        QMessageBox::StandardButton reply;
+        reply = QMessageBox::question(this, "Download", QString("%1 already has %2 of %3 bytes. Resume the download?").arg(filename).arg(info.size()).arg(size), QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel);
+        if (reply == QMessageBox::Cancel) {
+            return;
+        } else if (reply == QMessageBox::Yes) {
+            mode = QIODevice::WriteOnly | QIODevice::Append;
+            object.insert("offset", info.size());
+        }
+    }
 
-            socketStream << byteArray;
-        } else {
-            QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
+    if (!object.contains("offset") && !writeVersion(filePath, remoteVersion(object))) {
+        QMessageBox::critical(this,"Download", "An error occurred while trying to write the file.");
+        return;
+    }
+
+    // A fresh download of a big file is cut into ranges fetched side by side into the part file sized up front.
+    if (!sessionToken.isEmpty() && !object.contains("offset") && size >= PARALLEL_MIN_SIZE) {
+        QFile file(partPath(filePath));
+        if (!file.open(QIODevice::WriteOnly) || !file.resize(size)) {
+            QMessageBox::critical(this,"Download", "An error occurred while trying to write the file.");
+            return;
         }
-    } else {
-        QMessageBox::critical(this, "QTcpClient", "Not connected");
+        file.close();
+
+        displayMessage(QString("Download %1 over %2 connections").arg(filePath).arg(PARALLEL_STREAMS));
+        startParallel(filePath, size, QByteArray(), [object, filePath](RangeTransfer* transfer, qint64 offset, qint64 length) {
+            transfer->download(object, partPath(filePath), offset, length);
+        });
+        return;
     }
+
+    QFile* file = new QFile(partPath(filePath));
+    if (!file->open(mode)) {
+        delete file;
+        QMessageBox::critical(this,"Download", "An error occurred while trying to write the file.");
+        return;
+    }
+
+    QJsonDocument jsonDoc;
+    jsonDoc.setObject(object);
+    QString data = jsonDoc.toJson(QJsonDocument::Compact);
+    displayMessage(QString("Download ") + data);
+
+    // Chunks of several downloads arrive interleaved, each tagged with the id of its request.
+    quint32 requestId = sendRequest(RequestDownload, data.toUtf8());
+    if (requestId == 0) {
+        file->close();
+        delete file;
+        return;
+    }
+
+    PendingDownload download;
+    download.file = file;
+    download.filePath = filePath;
+    download.size = size;
+    download.remaining = 0;
+    downloads.insert(requestId, download);
 }
 
 void MainWindow::sendFile() {
-    QString filename =  QFileDialog::getOpenFileName(this, "Select File", QDir::currentPath(), "All files (*.*)");
-    if (filename.isNull() || filename.isEmpty()) {
+    QStringList filenames = QFileDialog::getOpenFileNames(this, "Select Files", QDir::currentPath(), "All files (*.*)");
+    if (filenames.isEmpty()) {
         displayMessage(QString("sendFile: Cancel"));
         return;
     }
 
+    // A single file goes over the main connection, where it can resume or go as a delta. Several,
+    // or one while another upload runs, are queued for the transfer manager.
+    if (filenames.size() > 1 || uploadFile) {
+        foreach (const QString& filename, filenames) {
+            transfers->addUpload(filename, currentPath);
+        }
+        showTransfers();
+        return;
+    }
+
+    QString filename = filenames.first();
+
     QFileInfo info(filename);
     if (!info.exists()) {
         displayMessage(QString("sendFile: file not exists"));
         return;
     }
 
-    QFile file(info.filePath());
-    if(file.open(QIODevice::ReadOnly)){
-        QString fileName(info.fileName());
-
-        QDataStream socketStream(socket);
-        socketStream.setVersion(QDataStream::Qt_5_15);
-
-        Request type = Request::RequestAddFile;
-        QByteArray typeArray = QByteArray::number(type);
-        typeArray.resize(8);
-
-        QByteArray header;
-        header.prepend(QString("%1;%2").arg(current.value("path").toString(), fileName).toUtf8());
-        header.resize(256);
-
-        QByteArray byteArray = file.readAll();
-        byteArray.prepend(header);
-        byteArray.prepend(typeArray);
+    uploadFile = new QFile(info.filePath());
+    if(uploadFile->open(QIODevice::ReadOnly)){
+        // Replacing a stored file of some size only sends what changed, given its signature.
+        bool stored = false;
+        if (const FileNode* folder = tree.find(currentPath)) {
+            foreach (const FileNode* child, folder->children) {
+                if (!child->dir && child->name == info.fileName()) {
+                    stored = child->size >= DELTA_MIN_SIZE;
+                }
+            }
+        }
 
-        socketStream << byteArray;
+        if (stored && uploadFile->size() >= DELTA_MIN_SIZE) {
+            QString str = QString("%1;%2").arg(currentPath, info.fileName());
+            sendRequest(RequestSignature, str.toUtf8());
+        } else if (!sessionToken.isEmpty() && uploadFile->size() >= PARALLEL_MIN_SIZE) {
+            // The ranges land in a part file named after a tag of this upload, then the main connection commits it.
+            QString folder = currentPath;
+            QString name = info.fileName();
+            qint64 size = uploadFile->size();
+            QString tag = QString::number(QRandomGenerator::global()->generate64(), 16);
+            QByteArray commit = QString("%1;%2;%3;%4").arg(folder, name).arg(size).arg(tag).toUtf8();
+
+            displayMessage(QString("Upload %1 over %2 connections").arg(info.filePath()).arg(PARALLEL_STREAMS));
+            int job = startParallel(QString(), size, commit, [folder, name, size, tag, info](RangeTransfer* transfer, qint64 offset, qint64 length) {
+                transfer->upload(folder, name, size, tag, info.filePath(), offset, length);
+            });
+            uploadJob = parallelJobs.contains(job) ? job : 0;
+        } else {
+            openUpload();
+        }
+        btnCancel->setVisible(uploadFile != nullptr);
     } else {
+        delete uploadFile;
+        uploadFile = nullptr;
         QMessageBox::critical(this, "File Client", "File is not readable!");
     }
 }
 
-void MainWindow::handleData(QByteArray data) {
-    int type = data.mid(0, 8).toInt();
-    data = data.mid(8);
+quint32 MainWindow::sendRequest(Request type, const QByteArray& data, quint8 flags) {
+    if(socket) {
+        if(socket->isOpen()) {
+            quint32 requestId = nextRequestId++;
+            socket->write(frameHeader(type, data.size(), requestId, flags));
+            socket->write(data);
+            return requestId;
+        } else {
+            QMessageBox::critical(this, "QTcpClient", "Socket doesn't seem to be opened");
+        }
+    } else {
+        QMessageBox::critical(this, "QTcpClient", "Not connected");
+    }
+
+    return 0;
+}
 
+void MainWindow::handleData(int type, quint32 requestId, QByteArray data) {
     switch (type) {
         case ResponseNone:
             displayMessage(QString("ResponseNone: ") + QString::fromStdString(data.toStdString()));
             break;
 
         case ResponseSignInSuccess:
-            displayMessage(QString("ResponseSignInSuccess: ") + QString::fromStdString(data.toStdString()));
+            displayMessage(QString("ResponseSignInSuccess: ") + QString(data).section(";", 0, 0));
+            sessionToken = QString(data).section(";", 1, 1).toUtf8();
+            transfers->setToken(sessionToken);
             currentUser = ui->edtUsername->text();
             ui->edtPassword->setText("");
             ui->stackedWidget->setCurrentIndex(1);
+            updateListWidget(nullptr);
+            tree.clear();
             sendGetData();
             break;
 
@@ -498,6 +575,9 @@ void MainWindow::handleData(QByteArray data) {
         case ResponseSignOutSuccess:
             displayMessage(QString("ResponseSignOutSuccess: ") + QString::fromStdString(data.toStdString()));
             currentUser = QString();
+            sessionToken = QByteArray();
+            transfers->setToken(sessionToken);
+            transfers->pauseAll();
             ui->stackedWidget->setCurrentIndex(0);
             break;
 
@@ -538,24 +618,90 @@ void MainWindow::handleData(QByteArray data) {
 
         case ResponseAddFileSuccess:
             displayMessage(QString("ResponseAddFolderSuccess: ") + QString::fromStdString(data.toStdString()));
+            closeUpload();
             processUpdateData(data);
             break;
 
         case ResponseAddFileError:
             displayMessage(QString("ResponseAddFolderError: ") + QString::fromStdString(data.toStdString()));
+            // A cancelled upload has nothing left to report.
+            if (uploadFile) {
+                closeUpload();
+                displayError(QString::fromStdString(data.toStdString()));
+            }
+            break;
+
+        case ResponseUploadOpenSuccess:
+            displayMessage(QString("ResponseUploadOpenSuccess: ") + QString::fromStdString(data.toStdString()));
+            processUploadOpen(data);
+            break;
+
+        case ResponseUploadOpenError:
+            displayMessage(QString("ResponseUploadOpenError: ") + QString::fromStdString(data.toStdString()));
+            closeUpload();
             displayError(QString::fromStdString(data.toStdString()));
             break;
 
+        case ResponseUploadChunkError:
+            displayMessage(QString("ResponseUploadChunkError: ") + QString::fromStdString(data.toStdString()));
+            if (uploadFile && uploadSession == QString(data).section(";", 0, 0).toInt()) {
+                closeUpload();
+                displayError(QString("Upload interrupted: %1. Upload the file again to resume.").arg(QString(data).section(";", 2)));
+            }
+            break;
+
+        case ResponseUploadCancel:
+            displayMessage(QString("ResponseUploadCancel: ") + QString::fromStdString(data.toStdString()));
+            break;
+
+        case ResponseSignature:
+            displayMessage(QString("ResponseSignature: %1 bytes").arg(data.size()));
+            processSignature(data);
+            break;
+
+        case ResponseSignatureError:
+            displayMessage(QString("ResponseSignatureError: ") + QString::fromStdString(data.toStdString()));
+            if (uploadFile) {
+                openUpload();
+            }
+            break;
+
+        case ResponseDeltaError:
+            displayMessage(QString("ResponseDeltaError: ") + QString::fromStdString(data.toStdString()));
+            // Every later frame of a failed delta is refused as well, only the first one falls back.
+            if (uploadFile && uploadSession != 0 && uploadSession == QString(data).section(";", 0, 0).toInt()) {
+                uploadSession = 0;
+                delete delta;
+                delta = nullptr;
+                displayMessage("Delta upload failed, sending the whole file");
+                openUpload();
+            }
+            break;
+
+        case ResponseHello:
+            compression = data == COMPRESSION_CODEC;
+            displayMessage(QString("ResponseHello: compression %1").arg(compression ? "on" : "off"));
+            break;
+
         case ResponseDownloadSuccess:
             displayMessage(QString("ResponseDownloadSuccess: OK"));
-            processDownloadFile(data);
+            processDownloadFile(requestId, data);
             break;
 
         case ResponseDownloadError:
             displayMessage(QString("ResponseDownloadError: ") + QString::fromStdString(data.toStdString()));
+            if (downloads.contains(requestId)) {
+                PendingDownload download = downloads.take(requestId);
+                download.file->close();
+                delete download.file;
+            }
             displayError(QString::fromStdString(data.toStdString()));
             break;
 
+        case ResponseDownloadChunk:
+            processDownloadChunk(requestId, data);
+            break;
+
         default:
             break;
     }
@@ -563,62 +709,570 @@ void MainWindow::handleData(QByteArray data) {
 
 void MainWindow::processGetDataSuccess(QByteArray data) {
     QJsonDocument jsonDoc = QJsonDocument::fromJson(data);
-    this->jsonData = jsonDoc.object();
-    updateListWidget(jsonData);
+    QJsonObject folder = jsonDoc.object();
+    QString path = folder.value("path").toString();
+    QString next = folder.value("next").toString();
+    bool append = folder.contains("cursor");
+
+    folder.remove("total");
+    folder.remove("cursor");
+    folder.remove("next");
+
+    if (!tree.setListing(folder, append)) {
+        return;
+    }
+
+    // Each page is shown as soon as it arrives, the rest keeps coming behind it.
+    if (!next.isEmpty()) {
+        sendGetData(path, next);
+    }
+
+    // A listing of the shown folder or one above it replaces nodes the view reads from.
+    bool above = currentPath.startsWith(path) && currentPath.size() > path.size() && (currentPath.at(path.size()) == '/' || currentPath.at(path.size()) == '\\');
+    if (currentPath.isEmpty() || currentPath == path || above) {
+        FileNode* shown = tree.find(currentPath.isEmpty() ? path : currentPath);
+        updateListWidget(shown ? shown : tree.root());
+    }
 }
 
 void MainWindow::processUpdateData(QByteArray data) {
     QJsonDocument jsonDoc = QJsonDocument::fromJson(data);
-    this->jsonData = jsonDoc.object();
+    QJsonObject delta = jsonDoc.object();
 
-    QQueue<QJsonObject> queue;
-    queue.enqueue(jsonData);
-    while (!queue.isEmpty()) {
-        QJsonObject object = queue.dequeue();
-        if (object.value("path").toString() == current.value("path").toString()) {
-            updateListWidget(object);
+    if (!tree.root() || !tree.apply(delta)) {
+        currentPath = QString();
+        sendGetData();
+        return;
+    }
+
+    FileNode* folder = tree.find(currentPath);
+    updateListWidget(folder ? folder : tree.root());
+}
+
+void MainWindow::processDownloadFile(quint32 requestId, QByteArray data) {
+    QString header = data.mid(0, 128);
+
+    QStringList list = header.split(",");
+    QMap<quint32, PendingDownload>::iterator it = downloads.find(requestId);
+    if (list.size() < 4 || it == downloads.end()) {
+        displayMessage("processDownloadFile: Invalid data");
+        QMessageBox::warning(this, "Download", "Invalid data");
+        return;
+    }
+
+    QString filename = QStringList(list.mid(0, list.size() - 3)).join(",");
+    qint64 size = list[list.size() - 3].toLongLong();
+    qint64 offset = list[list.size() - 2].toLongLong();
+    qint64 length = list[list.size() - 1].toLongLong();
+
+    displayMessage(QString("Download file %1: %2 bytes from offset %3 of %4").arg(filename).arg(length).arg(offset).arg(size));
+
+    it.value().remaining = length;
+    it.value().size = size;
+
+    if (offset != it.value().file->size()) {
+        it.value().file->close();
+        delete it.value().file;
+        downloads.erase(it);
+        QMessageBox::critical(this,"Download", "The server sent a different range than requested.");
+        return;
+    }
+
+    processDownloadChunk(requestId, QByteArray());
+}
+
+void MainWindow::processDownloadChunk(quint32 requestId, QByteArray data) {
+    QMap<quint32, PendingDownload>::iterator it = downloads.find(requestId);
+    if (it == downloads.end()) {
+        return;
+    }
+
+    PendingDownload& download = it.value();
+    download.remaining -= data.size();
+
+    // Each chunk goes to disk as it arrives, nothing of the file is kept in memory.
+    if (!data.isEmpty() && download.file->write(data) != data.size()) {
+        download.file->close();
+        delete download.file;
+        downloads.erase(it);
+        QMessageBox::critical(this,"Download", "An error occurred while trying to write the file.");
+        return;
+    }
+
+    showProgress(QFileInfo(download.filePath).fileName(), download.size - download.remaining, download.size);
+    if (download.remaining > 0) {
+        return;
+    }
+
+    QString filePath = download.filePath;
+    download.file->close();
+    delete download.file;
+    downloads.erase(it);
+
+    if (!commitPart(filePath)) {
+        QMessageBox::critical(this,"Download", QString("The download is in %1, it could not replace %2.").arg(partPath(filePath), filePath));
+        return;
+    }
+
+    QString message = QString("Download file successfully stored on disk under the path %2").arg(QString(filePath));
+    emit newMessage(message);
+}
+
+void MainWindow::processUploadOpen(QByteArray data) {
+    QStringList list = QString(data).split(";");
+    if (list.size() < 2) {
+        return;
+    }
+
+    // Cancelled before the server had opened it, so the session is closed straight away.
+    if (!uploadFile) {
+        sendRequest(RequestUploadCancel, list[0].toUtf8());
+        return;
+    }
+
+    uploadSession = list[0].toInt();
+    qint64 received = list[1].toLongLong();
+    if (received > 0) {
+        displayMessage(QString("Resuming upload of %1 at byte %2").arg(uploadFile->fileName()).arg(received));
+    }
+
+    if (!uploadFile->seek(received)) {
+        closeUpload();
+        QMessageBox::critical(this, "File Client", "File is not readable!");
+        return;
+    }
+
+    uploadIndex = 0;
+    uploadCompress = compression;
+    sendUploadChunks();
+}
+
+void MainWindow::onBytesWritten(qint64 bytes) {
+    Q_UNUSED(bytes);
+
+    if (uploadFile && delta) {
+        scanDelta();
+    } else if (uploadFile && uploadIndex >= 0) {
+        sendUploadChunks();
+    }
+}
+
+void MainWindow::sendUploadChunks() {
+    // Only a window of the file is read ahead into the socket, the rest follows as it drains,
+    // so memory stays the same whatever the size of the file.
+    QByteArray chunk;
+    while (socket && !uploadFile->atEnd() && socket->bytesToWrite() < UPLOAD_WINDOW) {
+        if (chunk.isEmpty()) {
+            chunk.resize(UPLOAD_CHUNK_HEADER_SIZE + int(UPLOAD_CHUNK_SIZE));
+        }
+
+        // The file is read straight in behind the chunk header instead of being prepended to.
+        QByteArray header = QString("%1;%2;%3").arg(uploadSession).arg(uploadIndex).arg(uploadFile->pos()).toUtf8();
+        std::memset(chunk.data(), 0, UPLOAD_CHUNK_HEADER_SIZE);
+        std::memcpy(chunk.data(), header.constData(), size_t(qMin(header.size(), UPLOAD_CHUNK_HEADER_SIZE - 1)));
+
+        qint64 read = uploadFile->read(chunk.data() + UPLOAD_CHUNK_HEADER_SIZE, UPLOAD_CHUNK_SIZE);
+        if (read <= 0) {
+            closeUpload();
+            QMessageBox::critical(this, "File Client", "File is not readable!");
+            return;
+        }
+
+        // Sampled on the first chunk, and the first chunk that does not shrink sends the rest as is.
+        if (uploadIndex == 0) {
+            uploadCompress = uploadCompress && worthCompressing(chunk.constData() + UPLOAD_CHUNK_HEADER_SIZE, int(read));
+        }
+
+        QByteArray payload = QByteArray::fromRawData(chunk.constData(), UPLOAD_CHUNK_HEADER_SIZE + int(read));
+        QByteArray compressed;
+        if (uploadCompress && compressPayload(payload.constData(), payload.size(), compressed)) {
+            sendRequest(RequestUploadChunk, compressed, FRAME_COMPRESSED);
+        } else {
+            uploadCompress = false;
+            sendRequest(RequestUploadChunk, payload);
+        }
+        uploadIndex++;
+    }
+
+    if (uploadFile) {
+        showProgress(QString("Upload %1").arg(QFileInfo(uploadFile->fileName()).fileName()), uploadFile->pos(), uploadFile->size());
+    }
+}
+
+void MainWindow::cancelUpload() {
+    if (!uploadFile) {
+        return;
+    }
+
+    // Ranges of a split upload go with their connections, the server drops the part file once
+    // the last of them is gone.
+    if (uploadJob != 0) {
+        ParallelJob cancelled = parallelJobs.take(uploadJob);
+        foreach (RangeTransfer* transfer, cancelled.transfers) {
+            transfer->abort();
+        }
+        if (!cancelled.commit.isEmpty()) {
+            sendRequest(RequestUploadCancel, cancelled.commit);
+        }
+    } else if (uploadSession != 0 && (uploadIndex >= 0 || delta)) {
+        sendRequest(RequestUploadCancel, QByteArray::number(uploadSession));
+    }
+
+    displayMessage(QString("Upload of %1 cancelled").arg(uploadFile->fileName()));
+    statusBar()->showMessage("Upload cancelled", 5000);
+    closeUpload();
+}
+
+void MainWindow::openUpload() {
+    // The server answers with what it already holds of this file, so a re-upload after
+    // a dropped connection resumes instead of starting over. Size and modification time
+    // tell it whether what it holds is of this same version.
+    QFileInfo info(uploadFile->fileName());
+    QString str = QString("%1;%2;%3;%4").arg(currentPath, info.fileName()).arg(uploadFile->size()).arg(info.lastModified().toMSecsSinceEpoch());
+    sendRequest(RequestUploadOpen, str.toUtf8());
+}
+
+void MainWindow::processSignature(QByteArray data) {
+    if (!uploadFile) {
+        return;
+    }
+
+    const int entrySize = 4 + DELTA_STRONG_SIZE;
+    if (data.size() < SIGNATURE_HEADER_SIZE) {
+        openUpload();
+        return;
+    }
+
+    quint32 session = qFromBigEndian<quint32>(data.constData());
+    int blockSize = int(qFromBigEndian<quint32>(data.constData() + 4));
+    qint64 baseSize = qint64(qFromBigEndian<quint64>(data.constData() + 8));
+    int count = (data.size() - SIGNATURE_HEADER_SIZE) / entrySize;
+    if (blockSize <= 0 || count != (baseSize + blockSize - 1) / blockSize || !uploadFile->seek(0)) {
+        openUpload();
+        return;
+    }
+    uploadSession = int(session);
+
+    delta = new DeltaScan;
+    delta->signature = data;
+    delta->session = session;
+    delta->blockSize = blockSize;
+    delta->count = count;
+    delta->lastSize = count > 0 ? int(baseSize - qint64(count - 1) * blockSize) : 0;
+    delta->pos = 0;
+    delta->literal = 0;
+    delta->eof = false;
+    delta->rolling = false;
+    delta->a = 0;
+    delta->b = 0;
+    delta->matched = 0;
+
+    // A 16-bit tag table in front of the hash keeps most positions down to one bit test.
+    delta->tags.resize(1 << 16);
+    for (int i = 0; i < count; i++) {
+        quint32 weak = qFromBigEndian<quint32>(data.constData() + SIGNATURE_HEADER_SIZE + i * entrySize);
+        delta->blocks.insert(weak, i);
+        delta->tags.setBit(int((weak ^ (weak >> 16)) & 0xffff));
+    }
+
+    delta->ops.resize(4);
+    qToBigEndian<quint32>(session, delta->ops.data());
+
+    scanDelta();
+}
+
+void MainWindow::scanDelta() {
+    if (!uploadFile || !delta) {
+        return;
+    }
+
+    // The window slides a byte at a time until it lines up with a stored block. Bytes it
+    // passes over go out as literals, matched blocks as a copy op. One read of the file is
+    // scanned per call and only a window of the delta is queued in the socket, the scan is
+    // picked up again once it drains or on the next turn of the event loop.
+    const int entrySize = 4 + DELTA_STRONG_SIZE;
+    DeltaScan& scan = *delta;
+    bool read = false;
+
+    forever {
+        if (!scan.eof && scan.window.size() - scan.pos <= scan.blockSize) {
+            if (read || socket->bytesToWrite() >= UPLOAD_WINDOW) {
+                if (socket->bytesToWrite() == 0) {
+                    QTimer::singleShot(0, this, &MainWindow::scanDelta);
+                }
+                showProgress(QString("Upload %1").arg(QFileInfo(uploadFile->fileName()).fileName()), uploadFile->pos(), uploadFile->size());
+                return;
+            }
+
+            appendLiteral(scan.ops, scan.window.constData() + scan.literal, scan.pos - scan.literal);
+            scan.window.remove(0, scan.pos);
+            scan.pos = 0;
+            scan.literal = 0;
+
+            QByteArray more = uploadFile->read(DELTA_READ_SIZE);
+            if (more.isEmpty()) {
+                scan.eof = true;
+            } else {
+                scan.whole.addData(more);
+                scan.window.append(more);
+            }
+            read = true;
+
+            flushDelta(scan.ops, false);
+            continue;
+        }
+
+        int length = qMin(scan.blockSize, scan.window.size() - scan.pos);
+        if (length == 0) {
             break;
         }
 
-        QJsonArray children = object.value("children").toArray();
-        for (int i = 0; i < children.count(); i++) {
-            QJsonObject child = children.at(i).toObject();
-            if (child.value("type").toString() == "dir") {
-                queue.enqueue(child);
+        if (!scan.rolling) {
+            weakChecksum(scan.window.constData() + scan.pos, length, scan.a, scan.b);
+            scan.rolling = true;
+        }
+
+        quint32 weak = weakDigest(scan.a, scan.b);
+        int match = -1;
+        if (scan.tags.testBit(int((weak ^ (weak >> 16)) & 0xffff))) {
+            QByteArray strong;
+            QMultiHash<quint32, int>::const_iterator it = scan.blocks.constFind(weak);
+            for (; it != scan.blocks.constEnd() && it.key() == weak; ++it) {
+                if ((it.value() == scan.count - 1 ? scan.lastSize : scan.blockSize) != length) {
+                    continue;
+                }
+
+                if (strong.isEmpty()) {
+                    strong = strongChecksum(scan.window.constData() + scan.pos, length);
+                }
+
+                if (std::memcmp(strong.constData(), scan.signature.constData() + SIGNATURE_HEADER_SIZE + it.value() * entrySize + 4, DELTA_STRONG_SIZE) == 0) {
+                    match = it.value();
+                    break;
+                }
             }
         }
+
+        if (match >= 0) {
+            appendLiteral(scan.ops, scan.window.constData() + scan.literal, scan.pos - scan.literal);
+
+            char op[DELTA_OP_SIZE];
+            op[0] = DELTA_COPY;
+            qToBigEndian<quint32>(quint32(match), op + 1);
+            scan.ops.append(op, DELTA_OP_SIZE);
+
+            scan.pos += length;
+            scan.literal = scan.pos;
+            scan.rolling = false;
+            scan.matched += length;
+
+            flushDelta(scan.ops, false);
+            continue;
+        }
+
+        // Roll one byte on, or at the end of the file let the window shrink.
+        uchar out = uchar(scan.window.at(scan.pos));
+        if (scan.pos + scan.blockSize < scan.window.size()) {
+            scan.a = scan.a - out + uchar(scan.window.at(scan.pos + scan.blockSize));
+            scan.b = scan.b - quint32(scan.blockSize) * out + scan.a;
+        } else {
+            scan.a -= out;
+            scan.b -= quint32(length) * out;
+        }
+        scan.pos++;
     }
+
+    appendLiteral(scan.ops, scan.window.constData() + scan.literal, scan.pos - scan.literal);
+    flushDelta(scan.ops, true);
+
+    QByteArray commit(4 + 8, Qt::Uninitialized);
+    qToBigEndian<quint32>(scan.session, commit.data());
+    qToBigEndian<quint64>(quint64(uploadFile->size()), commit.data() + 4);
+    commit.append(scan.whole.result());
+    sendRequest(RequestDeltaCommit, commit);
+
+    showProgress(QString("Upload %1").arg(QFileInfo(uploadFile->fileName()).fileName()), uploadFile->size(), uploadFile->size());
+    displayMessage(QString("Delta upload of %1: %2 of %3 bytes taken from the stored version").arg(uploadFile->fileName()).arg(scan.matched).arg(uploadFile->size()));
+
+    delete delta;
+    delta = nullptr;
 }
 
-void MainWindow::processDownloadFile(QByteArray data) {
-    QString header = data.mid(0, 128);
-    data = data.mid(128);
+void MainWindow::appendLiteral(QByteArray& ops, const char* data, int size) {
+    if (size <= 0) {
+        return;
+    }
 
-    QStringList list = header.split(",");
-    if (list.size() < 2) {
-        displayMessage("processDownloadFile: Invalid data");
-        QMessageBox::warning(this, "Download", "Invalid data");
+    char op[DELTA_OP_SIZE];
+    op[0] = DELTA_LITERAL;
+    qToBigEndian<quint32>(quint32(size), op + 1);
+    ops.append(op, DELTA_OP_SIZE);
+    ops.append(data, size);
+}
+
+void MainWindow::flushDelta(QByteArray& ops, bool force) {
+    // The first four bytes are the session id every frame starts with.
+    if (ops.size() <= 4 || (!force && ops.size() < DELTA_FRAME_SIZE)) {
         return;
     }
 
-    QString filename = list[0];
-    QString size = list[1];
+    QByteArray compressed;
+    if (compression && compressPayload(ops.constData(), ops.size(), compressed)) {
+        sendRequest(RequestDeltaChunk, compressed, FRAME_COMPRESSED);
+    } else {
+        sendRequest(RequestDeltaChunk, ops);
+    }
+    ops.resize(4);
+}
 
-    displayMessage("Download file " + filename);
+void MainWindow::closeUpload() {
+    delete delta;
+    delta = nullptr;
 
-    QString filePath = QFileDialog::getSaveFileName(this, tr("Save File"), QDir::currentPath() + QDir::separator() + filename);
-    displayMessage("Download save on " + filePath);
-    if (filePath.isEmpty()) {
-        QMessageBox::information(this,"Download", QString("File %1 discarded.").arg(filename));
+    if (uploadFile) {
+        uploadFile->close();
+        delete uploadFile;
+        uploadFile = nullptr;
+    }
+
+    uploadSession = 0;
+    uploadIndex = -1;
+    uploadJob = 0;
+    btnCancel->setVisible(false);
+}
+
+int MainWindow::startParallel(const QString& localPath, qint64 size, const QByteArray& commit, const std::function<void(RangeTransfer*, qint64, qint64)>& start) {
+    int job = nextJob++;
+    ParallelJob parallel;
+    parallel.localPath = localPath;
+    parallel.commit = commit;
+    parallel.size = size;
+    parallel.done = 0;
+    parallel.pending = PARALLEL_STREAMS;
+    parallelJobs.insert(job, parallel);
+
+    qint64 rangeSize = (size + PARALLEL_STREAMS - 1) / PARALLEL_STREAMS;
+    for (int i = 0; i < PARALLEL_STREAMS; i++) {
+        // Only used from PARALLEL_MIN_SIZE on, so no range comes out empty.
+        qint64 offset = i * rangeSize;
+        qint64 length = qMin(rangeSize, size - offset);
+
+        RangeTransfer* transfer = new RangeTransfer(sessionToken, this);
+        connect(transfer, &RangeTransfer::progress, this, [this, job](qint64 bytes) {
+            QMap<int, ParallelJob>::iterator it = parallelJobs.find(job);
+            if (it != parallelJobs.end()) {
+                it.value().done += bytes;
+                showProgress(it.value().commit.isEmpty() ? QFileInfo(it.value().localPath).fileName() : QString("Upload"), it.value().done, it.value().size);
+            }
+        });
+        connect(transfer, &RangeTransfer::finished, this, [this, job, transfer](bool ok, const QString& error) {
+            transfer->deleteLater();
+            finishRange(job, ok, error);
+        });
+
+        parallelJobs[job].transfers.append(transfer);
+        start(transfer, offset, length);
+    }
+
+    return job;
+}
+
+void MainWindow::finishRange(int job, bool ok, const QString& error) {
+    QMap<int, ParallelJob>::iterator it = parallelJobs.find(job);
+    if (it == parallelJobs.end()) {
+        return;
+    }
+
+    ParallelJob& parallel = it.value();
+    if (!ok && parallel.error.isEmpty()) {
+        parallel.error = error;
+    }
+    if (--parallel.pending > 0) {
+        return;
+    }
+
+    ParallelJob finished = parallelJobs.take(job);
+    bool upload = !finished.commit.isEmpty();
+    if (!finished.error.isEmpty()) {
+        // Ranges of a download fill the file out of order, what there is of it cannot be resumed.
+        if (upload) {
+            sendRequest(RequestUploadCancel, finished.commit);
+            closeUpload();
+        } else {
+            QFile::remove(partPath(finished.localPath));
+            QFile::remove(versionPath(finished.localPath));
+        }
+        displayError(QString("%1 failed: %2").arg(upload ? "Upload" : "Download", finished.error));
         return;
     }
 
-    QFile file(filePath);
-    if (file.open(QIODevice::WriteOnly)) {
-        file.write(data);
-        QString message = QString("Download file successfully stored on disk under the path %2").arg(QString(filePath));
-        emit newMessage(message);
+    if (upload) {
+        sendRequest(RequestRangeCommit, finished.commit);
+    } else if (!commitPart(finished.localPath)) {
+        displayError(QString("The download is in %1, it could not replace %2.").arg(partPath(finished.localPath), finished.localPath));
     } else {
-        QMessageBox::critical(this,"Download", "An error occurred while trying to write the file.");
+        emit newMessage(QString("Download file successfully stored on disk under the path %1").arg(finished.localPath));
+    }
+}
+
+void MainWindow::showProgress(const QString& what, qint64 done, qint64 total) {
+    // Chunks arrive far more often than anyone can read, the status line is only redrawn now and then.
+    if (done < total && progressTimer.isValid() && progressTimer.elapsed() < PROGRESS_INTERVAL) {
+        return;
+    }
+    progressTimer.start();
+
+    int percent = total > 0 ? int(done * 100 / total) : 100;
+    statusBar()->showMessage(QString("%1: %2% (%3 of %4 KB)").arg(what).arg(percent).arg(done / 1024).arg(total / 1024), done < total ? 0 : 5000);
+}
+
+void MainWindow::sendFolder() {
+    QString dirPath = QFileDialog::getExistingDirectory(this, "Select Folder", QDir::currentPath());
+    if (dirPath.isEmpty()) {
+        displayMessage(QString("sendFolder: Cancel"));
+        return;
     }
+
+    // Every file brings the chain of folders it lives in, which its connection creates before
+    // the upload. Folders that exist already are simply refused.
+    QDir root(dirPath);
+    QString rootName = root.dirName();
+    QHash<QString, QStringList> chains;
+    int count = 0;
+
+    QDirIterator it(dirPath, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QFileInfo info(it.next());
+        QString relative = root.relativeFilePath(info.path());
+        if (relative == ".") {
+            relative = QString();
+        }
+
+        if (!chains.contains(relative)) {
+            QStringList chain;
+            QString parent = currentPath;
+            QStringList parts = QStringList(rootName) + relative.split("/", Qt::SkipEmptyParts);
+            foreach (const QString& part, parts) {
+                chain.append(parent + ";" + part);
+                parent += "/" + part;
+            }
+            chains.insert(relative, chain);
+        }
+
+        QString folder = currentPath + "/" + rootName + (relative.isEmpty() ? QString() : "/" + relative);
+        transfers->addUpload(info.filePath(), folder, chains.value(relative));
+        count++;
+    }
+
+    displayMessage(QString("Upload of %1: %2 files queued").arg(dirPath).arg(count));
+    showTransfers();
+}
+
+void MainWindow::showTransfers() {
+    if (!transferDialog) {
+        transferDialog = new TransferDialog(transfers, this);
+    }
+
+    transferDialog->show();
+    transferDialog->raise();
 }
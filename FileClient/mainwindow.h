@@ -10,13 +10,68 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+#include <QMultiHash>
+#include <QBitArray>
+#include <QPushButton>
 
-#include "itemwidget.h"
+#include <functional>
+
+#include "rangetransfer.h"
+#include "filetree.h"
+#include "filelistmodel.h"
+#include "transfermanager.h"
+#include "transferdialog.h"
+#include "../FileUtils/utils.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
 
+// A download spooled into <filePath>.part, which replaces filePath once complete.
+struct PendingDownload {
+    QFile* file;
+    QString filePath;
+    qint64 size;
+    qint64 remaining;
+};
+
+// How far the delta of an upload against the stored version has come. It is built a step at
+// a time as the socket drains, from where the window stopped sliding the last time.
+struct DeltaScan {
+    QByteArray signature;
+    QMultiHash<quint32, int> blocks;
+    QBitArray tags;
+    quint32 session;
+    int blockSize;
+    int count;
+    int lastSize;
+    QByteArray window;
+    int pos;
+    int literal;
+    bool eof;
+    bool rolling;
+    quint32 a;
+    quint32 b;
+    qint64 matched;
+    QByteArray ops;
+    QCryptographicHash whole{QCryptographicHash::Sha256};
+};
+
+// A transfer split over several RangeTransfers. Uploads are committed on the main
+// connection once every range is in.
+struct ParallelJob {
+    QString localPath;
+    QByteArray commit;
+    QList<RangeTransfer*> transfers;
+    qint64 size;
+    qint64 done;
+    int pending;
+    QString error;
+};
+
 class MainWindow : public QMainWindow {
     Q_OBJECT
 
@@ -30,30 +85,66 @@ signals:
 private slots:
     void displayMessage(const QString& msg);
     void displayError(const QString& msg);
-    void updateListWidget(const QJsonObject& data);
+    void updateListWidget(const FileNode* folder);
 
     void onReadyRead();
     void onSocketDisconnected();
     void onErrorOccurred(QAbstractSocket::SocketError error);
+    void onBytesWritten(qint64 bytes);
 
-    void sendGetData();
+    void sendGetData(const QString& path = QString(), const QString& cursor = QString());
     void sendDelete(QJsonObject object);
     void sendDownload(QJsonObject object);
     void sendFile();
+    void sendFolder();
+    void showTransfers();
+    quint32 sendRequest(Request type, const QByteArray& data, quint8 flags = 0);
 
-    void handleData(QByteArray data);
+    void handleData(int type, quint32 requestId, QByteArray data);
     void processGetDataSuccess(QByteArray data);
     void processUpdateData(QByteArray data);
-    void processDownloadFile(QByteArray data);
+    void processDownloadFile(quint32 requestId, QByteArray data);
+    void processDownloadChunk(quint32 requestId, QByteArray data);
+    void processUploadOpen(QByteArray data);
+    void sendUploadChunks();
+    void cancelUpload();
+    void openUpload();
+    void processSignature(QByteArray data);
+    void scanDelta();
+    void appendLiteral(QByteArray& ops, const char* data, int size);
+    void flushDelta(QByteArray& ops, bool force);
+    void closeUpload();
+    int startParallel(const QString& localPath, qint64 size, const QByteArray& commit, const std::function<void(RangeTransfer*, qint64, qint64)>& start);
+    void finishRange(int job, bool ok, const QString& error);
+    void showProgress(const QString& what, qint64 done, qint64 total);
 
 private:
     Ui::MainWindow* ui;
 
     QStringListModel* model;
     QTcpSocket* socket;
-    QList<ItemWidget*> items;
-    QJsonObject jsonData, current;
+    FileListModel* listModel;
+    TransferManager* transfers;
+    TransferDialog* transferDialog;
+    FileTree tree;
+    QString currentPath;
     QString currentUser;
+    QByteArray sessionToken;
+    QMap<int, ParallelJob> parallelJobs;
+    int nextJob;
+    QMap<quint32, PendingDownload> downloads;
+    QElapsedTimer progressTimer;
+    QFile* uploadFile;
+    int uploadSession;
+    int uploadIndex;
+    bool uploadCompress;
+    int uploadJob;
+    DeltaScan* delta;
+    QPushButton* btnCancel;
+    bool compression;
+    quint32 nextRequestId;
+    QByteArray input;
+    int inputPos;
 };
 
 #endif // !MAINWINDOW_H
@@ -0,0 +1,261 @@
+#include "rangetransfer.h"
+
+#include <QHostAddress>
+#include <QJsonDocument>
+
+#include <cstring>
+
+static const int MAX_FRAME_SIZE = 64 * 1024 * 1024;
+static const qint64 RANGE_CHUNK_SIZE = 256 * 1024;
+static const int RANGE_CHUNK_HEADER_SIZE = 64;
+// Bytes left in the socket before the next chunk is read, enough to keep the link busy.
+static const qint64 RANGE_WRITE_WINDOW = 4 * RANGE_CHUNK_SIZE;
+
+RangeTransfer::RangeTransfer(const QByteArray& token, QObject* parent)
+    : QObject(parent), token(token), uploading(false), cancelling(false), done(false), rangeId(0), offset(0), position(0), end(0) {
+    socket = new QTcpSocket(this);
+
+    connect(socket, &QTcpSocket::connected, this, &RangeTransfer::onConnected);
+    connect(socket, &QTcpSocket::readyRead, this, &RangeTransfer::onReadyRead);
+    connect(socket, &QTcpSocket::bytesWritten, this, &RangeTransfer::onBytesWritten);
+    connect(socket, &QTcpSocket::disconnected, this, &RangeTransfer::onDisconnected);
+    connect(socket, &QAbstractSocket::errorOccurred, this, [this]() {
+        finish(false, socket->errorString());
+    });
+}
+
+RangeTransfer::~RangeTransfer() {
+    // Nothing the socket does while it goes may reach a transfer that is being destroyed.
+    socket->disconnect(this);
+    file.close();
+}
+
+void RangeTransfer::download(const QJsonObject& object, const QString& localPath, qint64 offset, qint64 length) {
+    QJsonObject range = object;
+    range.insert("offset", offset);
+    range.insert("length", length);
+    request = QJsonDocument(range).toJson(QJsonDocument::Compact);
+
+    file.setFileName(localPath);
+    uploading = false;
+    this->offset = offset;
+    position = offset;
+    end = offset + length;
+    start();
+}
+
+void RangeTransfer::upload(const QString& folder, const QString& name, qint64 size, const QString& tag, const QString& localPath, qint64 offset, qint64 length, bool commit) {
+    request = QString("%1;%2;%3;%4;%5;%6").arg(folder, name).arg(size).arg(offset).arg(length).arg(tag).toUtf8();
+    if (commit) {
+        commitRequest = QString("%1;%2;%3;%4").arg(folder, name).arg(size).arg(tag).toUtf8();
+    }
+
+    file.setFileName(localPath);
+    uploading = true;
+    this->offset = offset;
+    position = offset;
+    end = offset + length;
+    start();
+}
+
+void RangeTransfer::cancelUpload(const QString& folder, const QString& name, qint64 size, const QString& tag) {
+    request = QString("%1;%2;%3;%4").arg(folder, name).arg(size).arg(tag).toUtf8();
+    cancelling = true;
+    socket->connectToHost(QHostAddress::LocalHost, 2209);
+}
+
+void RangeTransfer::setFolders(const QStringList& folders) {
+    this->folders = folders;
+}
+
+qint64 RangeTransfer::pos() const {
+    return position;
+}
+
+void RangeTransfer::start() {
+    // Downloads write into the file the caller sized beforehand, so it must not be truncated here.
+    if (!file.open(uploading ? QIODevice::ReadOnly : QIODevice::ReadWrite) || !file.seek(offset)) {
+        finish(false, file.errorString());
+        return;
+    }
+
+    socket->connectToHost(QHostAddress::LocalHost, 2209);
+}
+
+void RangeTransfer::onConnected() {
+    socket->write(frameHeader(RequestAttach, token.size()));
+    socket->write(token);
+}
+
+void RangeTransfer::onReadyRead() {
+    input.append(socket->readAll());
+
+    int pos = 0;
+    while (!done && input.size() - pos >= FRAME_HEADER_SIZE) {
+        FrameHeader header;
+        if (!readFrameHeader(input.constData() + pos, header) || header.length > quint64(MAX_FRAME_SIZE)) {
+            finish(false, "Invalid frame header");
+            return;
+        }
+
+        int frameSize = FRAME_HEADER_SIZE + int(header.length);
+        if (input.size() - pos < frameSize) {
+            break;
+        }
+
+        QByteArray payload = input.mid(pos + FRAME_HEADER_SIZE, int(header.length));
+        pos += frameSize;
+        if ((header.flags & FRAME_COMPRESSED) && !uncompressPayload(payload, MAX_FRAME_SIZE, payload)) {
+            finish(false, "Invalid compressed data");
+            return;
+        }
+        handleData(header.type, payload);
+    }
+
+    input.remove(0, pos);
+}
+
+void RangeTransfer::handleData(int type, const QByteArray& data) {
+    switch (type) {
+        case ResponseAttachSuccess:
+            if (cancelling) {
+                socket->write(frameHeader(RequestUploadCancel, request.size()));
+                socket->write(request);
+                break;
+            }
+
+            // Requests are handled in order, the folders exist by the time the range is opened.
+            foreach (const QString& folder, folders) {
+                QByteArray byteArray = folder.toUtf8();
+                socket->write(frameHeader(RequestAddFolder, byteArray.size()));
+                socket->write(byteArray);
+            }
+            socket->write(frameHeader(uploading ? RequestRangeOpen : RequestDownload, request.size()));
+            socket->write(request);
+            break;
+
+        case ResponseAddFolderSuccess:
+            emit treeChanged(data);
+            break;
+
+        case ResponseAddFolderError:
+            // Mostly a folder that exists already, anything worse fails the range open.
+            break;
+
+        case ResponseRangeOpen:
+            // The server may already hold the start of the range from an earlier connection.
+            rangeId = QString(data).section(";", 0, 0).toInt();
+            if (QString(data).section(";", 1, 1).toLongLong() > position) {
+                qint64 skipped = qMin(QString(data).section(";", 1, 1).toLongLong(), end) - position;
+                if (!file.seek(position + skipped)) {
+                    finish(false, file.errorString());
+                    return;
+                }
+                position += skipped;
+                emit progress(skipped);
+            }
+            sendChunks();
+            break;
+
+        case ResponseRangeDone:
+            if (position != end) {
+                finish(false, "The server closed the range early");
+            } else if (!commitRequest.isEmpty()) {
+                socket->write(frameHeader(RequestRangeCommit, commitRequest.size()));
+                socket->write(commitRequest);
+            } else {
+                finish(true, QString());
+            }
+            break;
+
+        case ResponseAddFileSuccess:
+            emit treeChanged(data);
+            finish(true, QString());
+            break;
+
+        case ResponseUploadCancel:
+            finish(true, QString());
+            break;
+
+        case ResponseDownloadSuccess:
+            if (position >= end) {
+                finish(true, QString());
+            }
+            break;
+
+        case ResponseDownloadChunk:
+            if (file.write(data) != data.size()) {
+                finish(false, file.errorString());
+                return;
+            }
+
+            position += data.size();
+            emit progress(data.size());
+            if (position >= end) {
+                finish(true, QString());
+            }
+            break;
+
+        case ResponseAttachError:
+        case ResponseAddFileError:
+        case ResponseRangeError:
+        case ResponseDownloadError:
+            finish(false, QString::fromUtf8(data));
+            break;
+
+        default:
+            break;
+    }
+}
+
+void RangeTransfer::onBytesWritten(qint64 bytes) {
+    Q_UNUSED(bytes);
+
+    if (uploading && rangeId != 0) {
+        sendChunks();
+    }
+}
+
+void RangeTransfer::sendChunks() {
+    // Read as the socket drains instead of queueing the whole range in memory at once.
+    QByteArray chunk;
+    while (!done && position < end && socket->bytesToWrite() < RANGE_WRITE_WINDOW) {
+        if (chunk.isEmpty()) {
+            chunk.resize(RANGE_CHUNK_HEADER_SIZE + int(RANGE_CHUNK_SIZE));
+        }
+
+        QByteArray header = QString("%1;%2").arg(rangeId).arg(position).toUtf8();
+        std::memset(chunk.data(), 0, RANGE_CHUNK_HEADER_SIZE);
+        std::memcpy(chunk.data(), header.constData(), size_t(qMin(header.size(), RANGE_CHUNK_HEADER_SIZE - 1)));
+
+        qint64 read = file.read(chunk.data() + RANGE_CHUNK_HEADER_SIZE, qMin(RANGE_CHUNK_SIZE, end - position));
+        if (read <= 0) {
+            finish(false, "File is not readable");
+            return;
+        }
+
+        socket->write(frameHeader(RequestRangeChunk, RANGE_CHUNK_HEADER_SIZE + read));
+        socket->write(chunk.constData(), RANGE_CHUNK_HEADER_SIZE + read);
+        position += read;
+        emit progress(read);
+    }
+}
+
+void RangeTransfer::abort() {
+    finish(false, "Cancelled");
+}
+
+void RangeTransfer::onDisconnected() {
+    finish(false, "Connection closed");
+}
+
+void RangeTransfer::finish(bool ok, const QString& error) {
+    if (done) {
+        return;
+    }
+    done = true;
+
+    file.close();
+    socket->disconnectFromHost();
+    emit finished(ok, error);
+}
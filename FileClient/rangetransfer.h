@@ -0,0 +1,64 @@
+#ifndef RANGETRANSFER_H
+#define RANGETRANSFER_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QFile>
+#include <QJsonObject>
+#include <QStringList>
+
+#include "../FileUtils/utils.h"
+
+// One byte range of a file moved over a connection of its own, attached to the signed
+// in session by its token. Each range keeps its own handle on the local file and only
+// touches its own part of it, so several of them run side by side. A range covering a
+// whole upload can commit it on the same connection, after creating its folders first.
+// A transfer can also just give up an upload, so the server drops what it holds of it.
+class RangeTransfer : public QObject {
+    Q_OBJECT
+
+public:
+    RangeTransfer(const QByteArray& token, QObject* parent = nullptr);
+    ~RangeTransfer();
+
+    void download(const QJsonObject& object, const QString& localPath, qint64 offset, qint64 length);
+    void upload(const QString& folder, const QString& name, qint64 size, const QString& tag, const QString& localPath, qint64 offset, qint64 length, bool commit = false);
+    void cancelUpload(const QString& folder, const QString& name, qint64 size, const QString& tag);
+    void setFolders(const QStringList& folders);
+    void abort();
+    qint64 pos() const;
+
+signals:
+    void progress(qint64 bytes);
+    void treeChanged(const QByteArray& delta);
+    void finished(bool ok, const QString& error);
+
+private slots:
+    void onConnected();
+    void onReadyRead();
+    void onBytesWritten(qint64 bytes);
+    void onDisconnected();
+
+private:
+    void start();
+    void handleData(int type, const QByteArray& data);
+    void sendChunks();
+    void finish(bool ok, const QString& error);
+
+    QTcpSocket* socket;
+    QFile file;
+    QByteArray token;
+    QByteArray request;
+    QByteArray commitRequest;
+    QStringList folders;
+    bool uploading;
+    bool cancelling;
+    bool done;
+    int rangeId;
+    qint64 offset;
+    qint64 position;
+    qint64 end;
+    QByteArray input;
+};
+
+#endif // !RANGETRANSFER_H
@@ -0,0 +1,55 @@
+#include "transferdialog.h"
+
+#include "ui_transferdialog.h"
+
+#include <QHeaderView>
+#include <QItemSelectionModel>
+
+#include <algorithm>
+
+TransferDialog::TransferDialog(TransferManager* manager, QWidget* parent) : QDialog(parent), ui(new Ui::TransferDialog), manager(manager) {
+    ui->setupUi(this);
+
+    ui->tvTransfers->setModel(manager);
+    ui->tvTransfers->verticalHeader()->hide();
+    ui->tvTransfers->horizontalHeader()->setSectionResizeMode(TransferManager::ColumnName, QHeaderView::Stretch);
+    ui->tvTransfers->horizontalHeader()->setSectionResizeMode(TransferManager::ColumnStatus, QHeaderView::ResizeToContents);
+
+    ui->sbConcurrency->setValue(manager->concurrency());
+    connect(ui->sbConcurrency, QOverload<int>::of(&QSpinBox::valueChanged), manager, &TransferManager::setConcurrency);
+
+    connect(ui->btnPause, &QPushButton::clicked, this, [this]() {
+        foreach (int row, selectedRows()) {
+            this->manager->pause(row);
+        }
+    });
+
+    connect(ui->btnResume, &QPushButton::clicked, this, [this]() {
+        foreach (int row, selectedRows()) {
+            this->manager->resume(row);
+        }
+    });
+
+    connect(ui->btnCancel, &QPushButton::clicked, this, [this]() {
+        foreach (int row, selectedRows()) {
+            this->manager->cancel(row);
+        }
+    });
+
+    connect(ui->btnClear, &QPushButton::clicked, manager, &TransferManager::clearFinished);
+}
+
+TransferDialog::~TransferDialog() {
+    delete ui;
+}
+
+QList<int> TransferDialog::selectedRows() const {
+    QList<int> rows;
+    foreach (const QModelIndex& index, ui->tvTransfers->selectionModel()->selectedRows()) {
+        rows.append(index.row());
+    }
+
+    // In queue order, so resuming several keeps them in the order they were added.
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
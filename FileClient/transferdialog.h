@@ -0,0 +1,27 @@
+#ifndef TRANSFERDIALOG_H
+#define TRANSFERDIALOG_H
+
+#include <QDialog>
+
+#include "transfermanager.h"
+
+namespace Ui {
+class TransferDialog;
+}
+
+class TransferDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    explicit TransferDialog(TransferManager* manager, QWidget* parent = nullptr);
+    ~TransferDialog();
+
+private:
+    QList<int> selectedRows() const;
+
+    Ui::TransferDialog* ui;
+
+    TransferManager* manager;
+};
+
+#endif // !TRANSFERDIALOG_H
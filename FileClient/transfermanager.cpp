@@ -0,0 +1,409 @@
+#include "transfermanager.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QRandomGenerator>
+
+static const int DEFAULT_CONCURRENCY = 3;
+static const int SAMPLE_INTERVAL = 500;
+// Weight of the newest sample in the shown throughput, the rest is history.
+static const double RATE_SMOOTHING = 0.3;
+
+static QString partPath(const QString& filePath) {
+    return filePath + ".part";
+}
+
+static QString formatBytes(double bytes) {
+    static const char* const units[] = { "B", "KB", "MB", "GB", "TB" };
+
+    int unit = 0;
+    while (bytes >= 1024 && unit < 4) {
+        bytes /= 1024;
+        unit++;
+    }
+    return QString("%1 %2").arg(bytes, 0, 'f', unit == 0 ? 0 : 1).arg(units[unit]);
+}
+
+static QString formatDuration(qint64 seconds) {
+    if (seconds >= 3600) {
+        return QString("%1:%2:%3").arg(seconds / 3600).arg(seconds / 60 % 60, 2, 10, QChar('0')).arg(seconds % 60, 2, 10, QChar('0'));
+    }
+    return QString("%1:%2").arg(seconds / 60).arg(seconds % 60, 2, 10, QChar('0'));
+}
+
+TransferManager::TransferManager(QObject* parent) : QAbstractTableModel(parent), maxRunning(DEFAULT_CONCURRENCY) {
+    timer = new QTimer(this);
+    timer->setInterval(SAMPLE_INTERVAL);
+    connect(timer, &QTimer::timeout, this, &TransferManager::sample);
+}
+
+TransferManager::~TransferManager() {
+    foreach (TransferItem* item, items) {
+        if (item->transfer) {
+            item->transfer->disconnect(this);
+            delete item->transfer;
+        }
+    }
+    qDeleteAll(items);
+}
+
+void TransferManager::setToken(const QByteArray& token) {
+    this->token = token;
+    if (!token.isEmpty()) {
+        schedule();
+    }
+}
+
+void TransferManager::setConcurrency(int concurrency) {
+    maxRunning = qMax(1, concurrency);
+    schedule();
+}
+
+int TransferManager::concurrency() const {
+    return maxRunning;
+}
+
+void TransferManager::addUpload(const QString& localPath, const QString& folder, const QStringList& folders) {
+    QFileInfo info(localPath);
+
+    TransferItem* item = new TransferItem;
+    item->upload = true;
+    item->localPath = info.filePath();
+    item->folder = folder;
+    item->name = info.fileName();
+    item->folders = folders;
+    // The part file on the server is named after the tag, an upload resumed later finds its bytes there.
+    item->tag = QString::number(QRandomGenerator::global()->generate64(), 16);
+    item->size = info.size();
+    item->done = 0;
+    item->state = TransferItem::Queued;
+    item->transfer = nullptr;
+    item->sampled = 0;
+    item->rate = 0;
+
+    beginInsertRows(QModelIndex(), items.size(), items.size());
+    items.append(item);
+    endInsertRows();
+
+    schedule();
+}
+
+void TransferManager::addDownload(const QJsonObject& object, const QString& localPath) {
+    TransferItem* item = new TransferItem;
+    item->upload = false;
+    item->localPath = localPath;
+    item->name = object.value("name").toString();
+    item->object = object;
+    item->size = object.value("size").toVariant().toLongLong();
+    item->done = 0;
+    item->state = TransferItem::Queued;
+    item->transfer = nullptr;
+    item->sampled = 0;
+    item->rate = 0;
+
+    beginInsertRows(QModelIndex(), items.size(), items.size());
+    items.append(item);
+    endInsertRows();
+
+    schedule();
+}
+
+void TransferManager::pause(int row) {
+    if (row < 0 || row >= items.size()) {
+        return;
+    }
+
+    TransferItem* item = items.at(row);
+    if (item->state == TransferItem::Running) {
+        stop(row);
+    }
+    if (item->state == TransferItem::Running || item->state == TransferItem::Queued) {
+        item->state = TransferItem::Paused;
+        updateRow(row);
+    }
+
+    schedule();
+}
+
+void TransferManager::resume(int row) {
+    if (row < 0 || row >= items.size()) {
+        return;
+    }
+
+    TransferItem* item = items.at(row);
+    if (item->state == TransferItem::Paused || item->state == TransferItem::Failed) {
+        item->state = TransferItem::Queued;
+        item->error = QString();
+        updateRow(row);
+        schedule();
+    }
+}
+
+void TransferManager::cancel(int row) {
+    if (row < 0 || row >= items.size()) {
+        return;
+    }
+
+    TransferItem* item = items.at(row);
+    if (item->state == TransferItem::Done || item->state == TransferItem::Cancelled) {
+        return;
+    }
+
+    stop(row);
+    if (!item->upload) {
+        QFile::remove(partPath(item->localPath));
+    } else if (item->state != TransferItem::Queued && !token.isEmpty()) {
+        // The server drops what it holds of the upload once the aborted connection is gone as well.
+        RangeTransfer* transfer = new RangeTransfer(token, this);
+        connect(transfer, &RangeTransfer::finished, transfer, &QObject::deleteLater);
+        transfer->cancelUpload(item->folder, item->name, item->size, item->tag);
+    }
+
+    item->state = TransferItem::Cancelled;
+    updateRow(row);
+    schedule();
+}
+
+void TransferManager::pauseAll() {
+    for (int i = 0; i < items.size(); i++) {
+        pause(i);
+    }
+}
+
+void TransferManager::clearFinished() {
+    for (int i = items.size() - 1; i >= 0; i--) {
+        TransferItem::State state = items.at(i)->state;
+        if (state == TransferItem::Done || state == TransferItem::Cancelled) {
+            beginRemoveRows(QModelIndex(), i, i);
+            delete items.takeAt(i);
+            endRemoveRows();
+        }
+    }
+}
+
+int TransferManager::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : items.size();
+}
+
+int TransferManager::columnCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant TransferManager::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= items.size() || (role != Qt::DisplayRole && role != Qt::ToolTipRole)) {
+        return QVariant();
+    }
+
+    const TransferItem* item = items.at(index.row());
+    if (role == Qt::ToolTipRole) {
+        return item->error.isEmpty() ? item->localPath : item->error;
+    }
+
+    bool running = item->state == TransferItem::Running;
+    switch (index.column()) {
+        case ColumnName:
+            return item->name;
+
+        case ColumnType:
+            return item->upload ? "Upload" : "Download";
+
+        case ColumnProgress: {
+            int percent = item->size > 0 ? int(item->done * 100 / item->size) : 100;
+            return QString("%1% (%2 of %3)").arg(percent).arg(formatBytes(item->done), formatBytes(item->size));
+        }
+
+        case ColumnSpeed:
+            return running ? formatBytes(item->rate) + "/s" : QString();
+
+        case ColumnEta:
+            if (!running || item->rate < 1) {
+                return QString();
+            }
+            return formatDuration(qint64((item->size - item->done) / item->rate));
+
+        case ColumnStatus:
+            switch (item->state) {
+                case TransferItem::Queued: return "Queued";
+                case TransferItem::Running: return "Running";
+                case TransferItem::Paused: return "Paused";
+                case TransferItem::Done: return "Done";
+                case TransferItem::Failed: return QString("Failed: %1").arg(item->error);
+                case TransferItem::Cancelled: return "Cancelled";
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return QVariant();
+}
+
+QVariant TransferManager::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+
+    switch (section) {
+        case ColumnName: return "Name";
+        case ColumnType: return "Type";
+        case ColumnProgress: return "Progress";
+        case ColumnSpeed: return "Speed";
+        case ColumnEta: return "ETA";
+        case ColumnStatus: return "Status";
+        default: return QVariant();
+    }
+}
+
+void TransferManager::sample() {
+    double seconds = clock.isValid() ? clock.restart() / 1000.0 : 0;
+    if (!clock.isValid()) {
+        clock.start();
+    }
+
+    bool running = false;
+    foreach (TransferItem* item, items) {
+        if (item->state != TransferItem::Running) {
+            continue;
+        }
+
+        running = true;
+        if (seconds > 0) {
+            double rate = (item->done - item->sampled) / seconds;
+            item->rate = item->rate > 0 ? RATE_SMOOTHING * rate + (1 - RATE_SMOOTHING) * item->rate : rate;
+        }
+        item->sampled = item->done;
+    }
+
+    // One signal for the whole table, the view repaints only the rows in sight.
+    if (!items.isEmpty()) {
+        emit dataChanged(index(0, ColumnProgress), index(items.size() - 1, ColumnEta));
+    }
+
+    if (!running) {
+        timer->stop();
+        clock.invalidate();
+    }
+}
+
+void TransferManager::schedule() {
+    if (token.isEmpty()) {
+        return;
+    }
+
+    int running = 0;
+    foreach (const TransferItem* item, items) {
+        running += item->state == TransferItem::Running ? 1 : 0;
+    }
+
+    // Items start in the order they were added.
+    for (int i = 0; i < items.size() && running < maxRunning; i++) {
+        if (items.at(i)->state == TransferItem::Queued) {
+            start(i);
+            running++;
+        }
+    }
+}
+
+void TransferManager::start(int row) {
+    TransferItem* item = items.at(row);
+
+    // A download picks up from what its part file holds, an upload from what the server holds.
+    if (!item->upload && item->done == 0) {
+        QFile part(partPath(item->localPath));
+        if (!part.open(QIODevice::WriteOnly)) {
+            finishItem(item, false, part.errorString());
+            return;
+        }
+        part.close();
+    }
+    if (item->upload) {
+        item->done = 0;
+    }
+
+    RangeTransfer* transfer = new RangeTransfer(token, this);
+    item->transfer = transfer;
+    item->state = TransferItem::Running;
+    item->sampled = item->done;
+    item->rate = 0;
+
+    connect(transfer, &RangeTransfer::progress, this, [item](qint64 bytes) {
+        item->done += bytes;
+    });
+    connect(transfer, &RangeTransfer::treeChanged, this, &TransferManager::treeChanged);
+    connect(transfer, &RangeTransfer::finished, this, [this, item, transfer](bool ok, const QString& error) {
+        transfer->deleteLater();
+        if (item->transfer == transfer) {
+            item->transfer = nullptr;
+            finishItem(item, ok, error);
+        }
+    });
+
+    if (item->upload) {
+        transfer->setFolders(item->folders);
+        transfer->upload(item->folder, item->name, item->size, item->tag, item->localPath, 0, item->size, true);
+    } else {
+        transfer->download(item->object, partPath(item->localPath), item->done, item->size - item->done);
+    }
+
+    updateRow(row);
+    if (!timer->isActive()) {
+        timer->start();
+    }
+}
+
+void TransferManager::stop(int row) {
+    TransferItem* item = items.at(row);
+    RangeTransfer* transfer = item->transfer;
+    if (!transfer) {
+        return;
+    }
+
+    // Unhooked first, so the abort is not taken for a failure.
+    item->transfer = nullptr;
+    transfer->disconnect(this);
+    transfer->abort();
+    transfer->deleteLater();
+    item->rate = 0;
+}
+
+void TransferManager::finishItem(TransferItem* item, bool ok, const QString& error) {
+    QString failure = error;
+    if (ok && !item->upload) {
+        // The part file only replaces the destination once all of it is in.
+        bool replaced = (!QFileInfo::exists(item->localPath) || QFile::remove(item->localPath)) && QFile::rename(partPath(item->localPath), item->localPath);
+        if (!replaced) {
+            ok = false;
+            failure = QString("The download is in %1, it could not replace the file").arg(partPath(item->localPath));
+        }
+    }
+
+    if (ok) {
+        item->state = TransferItem::Done;
+        item->done = item->size;
+        emit itemFinished(QString("%1 of %2 done").arg(item->upload ? "Upload" : "Download", item->name));
+    } else {
+        item->state = TransferItem::Failed;
+        item->error = failure;
+        emit itemFinished(QString("%1 of %2 failed: %3").arg(item->upload ? "Upload" : "Download", item->name, failure));
+    }
+    item->rate = 0;
+
+    updateRow(row(item));
+    schedule();
+}
+
+int TransferManager::row(const TransferItem* item) const {
+    for (int i = 0; i < items.size(); i++) {
+        if (items.at(i) == item) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void TransferManager::updateRow(int row) {
+    if (row >= 0) {
+        emit dataChanged(index(row, 0), index(row, ColumnCount - 1));
+    }
+}
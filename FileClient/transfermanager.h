@@ -0,0 +1,100 @@
+#ifndef TRANSFERMANAGER_H
+#define TRANSFERMANAGER_H
+
+#include <QAbstractTableModel>
+#include <QList>
+#include <QJsonObject>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include "rangetransfer.h"
+
+struct TransferItem {
+    enum State {
+        Queued,
+        Running,
+        Paused,
+        Done,
+        Failed,
+        Cancelled
+    };
+
+    bool upload;
+    QString localPath;
+    QString folder;
+    QString name;
+    QStringList folders;
+    QJsonObject object;
+    QString tag;
+    qint64 size;
+    qint64 done;
+    State state;
+    QString error;
+    RangeTransfer* transfer;
+    // Throughput over the last sample, smoothed.
+    qint64 sampled;
+    double rate;
+};
+
+// Queue of uploads and downloads running in the background, each over a connection of
+// its own attached to the session. A fixed number of them run at once, the rest wait
+// in order. The model is the live view of the queue, refreshed on a timer.
+class TransferManager : public QAbstractTableModel {
+    Q_OBJECT
+
+public:
+    enum Column {
+        ColumnName,
+        ColumnType,
+        ColumnProgress,
+        ColumnSpeed,
+        ColumnEta,
+        ColumnStatus,
+        ColumnCount
+    };
+
+    explicit TransferManager(QObject* parent = nullptr);
+    ~TransferManager();
+
+    void setToken(const QByteArray& token);
+    void setConcurrency(int concurrency);
+    int concurrency() const;
+
+    void addUpload(const QString& localPath, const QString& folder, const QStringList& folders = QStringList());
+    void addDownload(const QJsonObject& object, const QString& localPath);
+
+    void pause(int row);
+    void resume(int row);
+    void cancel(int row);
+    void pauseAll();
+    void clearFinished();
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+signals:
+    void treeChanged(const QByteArray& delta);
+    void itemFinished(const QString& message);
+
+private slots:
+    void sample();
+
+private:
+    void schedule();
+    void start(int row);
+    void stop(int row);
+    void finishItem(TransferItem* item, bool ok, const QString& error);
+    int row(const TransferItem* item) const;
+    void updateRow(int row);
+
+    QByteArray token;
+    QList<TransferItem*> items;
+    int maxRunning;
+    QTimer* timer;
+    QElapsedTimer clock;
+};
+
+#endif // !TRANSFERMANAGER_H
@@ -10,10 +10,24 @@ CONFIG += c++17
 
 SOURCES += \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    accountstore.cpp \
+    blockstore.cpp \
+    logger.cpp \
+    metadatacache.cpp \
+    server.cpp \
+    serverconfig.cpp \
+    worker.cpp
 
 HEADERS += \
     mainwindow.h \
+    accountstore.h \
+    blockstore.h \
+    logger.h \
+    metadatacache.h \
+    server.h \
+    serverconfig.h \
+    worker.h \
     ../FileUtils/utils.h
 
 FORMS += \
@@ -0,0 +1,198 @@
+#include "accountstore.h"
+
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+#include <QList>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+AccountStore::AccountStore(const QString& journalPath, const QString& legacyPath)
+    : journalPath(journalPath), legacyPath(legacyPath), migrated(0) {
+
+}
+
+AccountStore::~AccountStore() {
+    journal.close();
+}
+
+bool AccountStore::open() {
+    if (!QFileInfo::exists(journalPath) && QFileInfo::exists(legacyPath)) {
+        if (!migrate()) {
+            return false;
+        }
+    } else if (!load()) {
+        return false;
+    }
+
+    journal.setFileName(journalPath);
+    if (!journal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        error = journal.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+QString AccountStore::errorString() const {
+    return error;
+}
+
+int AccountStore::migratedCount() const {
+    return migrated;
+}
+
+bool AccountStore::contains(const QString& username) const {
+    return accounts.contains(username.toCaseFolded());
+}
+
+QString AccountStore::password(const QString& username) const {
+    // Names are unique regardless of case, but signing in takes the exact name the
+    // account was created with since its folder is named after it.
+    Account account = accounts.value(username.toCaseFolded());
+    if (account.username != username) {
+        return QString();
+    }
+
+    return account.password;
+}
+
+bool AccountStore::add(const QString& username, const QString& password) {
+    QString key = username.toCaseFolded();
+    if (accounts.contains(key)) {
+        return false;
+    }
+
+    Account account;
+    account.username = username;
+    account.password = password;
+    if (!append(account)) {
+        return false;
+    }
+
+    accounts.insert(key, account);
+    return true;
+}
+
+bool AccountStore::load() {
+    QFile file(journalPath);
+    if (!file.exists()) {
+        return true;
+    }
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    QByteArray data = file.readAll();
+    file.close();
+
+    // Later records win. Duplicates, broken records and a last line without its newline,
+    // a write cut short by a crash, get the journal compacted before it is appended to.
+    bool dirty = false;
+    int start = 0;
+    while (start < data.size()) {
+        int end = data.indexOf('\n', start);
+        if (end < 0) {
+            dirty = true;
+            break;
+        }
+
+        QList<QByteArray> fields = data.mid(start, end - start).split(' ');
+        start = end + 1;
+
+        if (fields.size() != 3 || fields[0] != "+") {
+            dirty = true;
+            continue;
+        }
+
+        Account account;
+        account.username = QString::fromUtf8(QByteArray::fromPercentEncoding(fields[1]));
+        account.password = QString::fromUtf8(QByteArray::fromPercentEncoding(fields[2]));
+
+        QString key = account.username.toCaseFolded();
+        if (accounts.contains(key)) {
+            dirty = true;
+        }
+        accounts.insert(key, account);
+    }
+
+    if (dirty) {
+        return compact();
+    }
+
+    return true;
+}
+
+bool AccountStore::migrate() {
+    QSettings settings(legacyPath, QSettings::IniFormat);
+    foreach (const QString& username, settings.allKeys()) {
+        Account account;
+        account.username = username;
+        account.password = settings.value(username).toString();
+        accounts.insert(username.toCaseFolded(), account);
+    }
+
+    if (!compact()) {
+        return false;
+    }
+
+    // Kept as a backup, the journal is the store from now on.
+    migrated = accounts.size();
+    QFile::rename(legacyPath, legacyPath + ".migrated");
+    return true;
+}
+
+bool AccountStore::append(const Account& account) {
+    QByteArray record = encode(account);
+    if (journal.write(record) != record.size() || !journal.flush()) {
+        error = journal.errorString();
+        return false;
+    }
+
+#ifdef Q_OS_UNIX
+    if (::fsync(journal.handle()) != 0) {
+        error = "fsync failed";
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+bool AccountStore::compact() {
+    bool reopen = journal.isOpen();
+    journal.close();
+
+    QSaveFile file(journalPath);
+    bool ok = file.open(QIODevice::WriteOnly);
+    if (ok) {
+        foreach (const Account& account, accounts) {
+            file.write(encode(account));
+        }
+        ok = file.commit();
+    }
+
+    if (!ok) {
+        error = file.errorString();
+    }
+
+    if (reopen && !journal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        error = journal.errorString();
+        return false;
+    }
+
+    return ok;
+}
+
+QByteArray AccountStore::encode(const Account& account) {
+    QByteArray record = "+ ";
+    record.append(account.username.toUtf8().toPercentEncoding());
+    record.append(' ');
+    record.append(account.password.toUtf8().toPercentEncoding());
+    record.append('\n');
+    return record;
+}
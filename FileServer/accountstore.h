@@ -0,0 +1,44 @@
+#ifndef ACCOUNTSTORE_H
+#define ACCOUNTSTORE_H
+
+#include <QString>
+#include <QHash>
+#include <QFile>
+
+struct Account {
+    QString username;
+    QString password;
+};
+
+// Accounts held in a case-insensitive hash and persisted as an append-only journal,
+// one percent-encoded record per line. Accounts are only ever added, so the journal is
+// only rewritten when it is found holding duplicate or broken records at startup.
+class AccountStore {
+public:
+    AccountStore(const QString& journalPath, const QString& legacyPath);
+    ~AccountStore();
+
+    bool open();
+    QString errorString() const;
+    int migratedCount() const;
+
+    bool contains(const QString& username) const;
+    QString password(const QString& username) const;
+    bool add(const QString& username, const QString& password);
+
+private:
+    bool load();
+    bool migrate();
+    bool append(const Account& account);
+    bool compact();
+    static QByteArray encode(const Account& account);
+
+    QString journalPath;
+    QString legacyPath;
+    QFile journal;
+    QHash<QString, Account> accounts;
+    int migrated;
+    QString error;
+};
+
+#endif // !ACCOUNTSTORE_H
@@ -0,0 +1,480 @@
+#include "blockstore.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QCryptographicHash>
+#include <QMessageAuthenticationCode>
+#include <QRandomGenerator>
+#include <QMutexLocker>
+
+#include <algorithm>
+
+static const QByteArray MANIFEST_MAGIC = "FSBLOCKS2 ";
+static const int HASH_HEX_SIZE = 64;
+static const int KEY_SIZE = 32;
+static const int READ_BUFFER_SIZE = 1024 * 1024;
+// Cut points fall where the top 16 bits of the rolling hash are zero, 64 KiB apart on average.
+static const int MIN_BLOCK_SIZE = 16 * 1024;
+static const int MAX_BLOCK_SIZE = 256 * 1024;
+static const quint64 BOUNDARY_MASK = Q_UINT64_C(0xffff000000000000);
+
+// Compared in full whatever the first difference, so the time taken tells nothing about the MAC.
+static bool sameDigest(const QByteArray& a, const QByteArray& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+
+    uchar diff = 0;
+    for (int i = 0; i < a.size(); i++) {
+        diff |= uchar(a.at(i) ^ b.at(i));
+    }
+    return diff == 0;
+}
+
+static const quint64* gearTable() {
+    static quint64 table[256];
+    static bool ready = [] {
+        // Fixed seed: the same content has to be cut the same way on every run.
+        quint64 state = Q_UINT64_C(0x9e3779b97f4a7c15);
+        for (int i = 0; i < 256; i++) {
+            state += Q_UINT64_C(0x9e3779b97f4a7c15);
+            quint64 z = state;
+            z = (z ^ (z >> 30)) * Q_UINT64_C(0xbf58476d1ce4e5b9);
+            z = (z ^ (z >> 27)) * Q_UINT64_C(0x94d049bb133111eb);
+            table[i] = z ^ (z >> 31);
+        }
+        return true;
+    }();
+    Q_UNUSED(ready);
+
+    return table;
+}
+
+BlockStore::BlockStore(const QString& blocksPath, const QString& dataPath, const QString& keyPath)
+    : blocksPath(blocksPath), dataPath(dataPath), referencedBytes(0), storedBytes(0) {
+    loadKey(keyPath);
+}
+
+void BlockStore::rebuild() {
+    {
+        QMutexLocker locker(&mutex);
+        refs.clear();
+        referencedBytes = 0;
+        storedBytes = 0;
+
+        QDirIterator blocks(blocksPath, QDir::Files, QDirIterator::Subdirectories);
+        while (blocks.hasNext()) {
+            blocks.next();
+            storedBytes += blocks.fileInfo().size();
+        }
+    }
+
+    // Hidden files too: a part file turned into a manifest just before a crash still holds its blocks.
+    QDirIterator files(dataPath, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+    while (files.hasNext()) {
+        QList<BlockRef> blocks;
+        qint64 size;
+        if (readManifest(files.next(), blocks, size)) {
+            reference(blocks);
+        }
+    }
+}
+
+bool BlockStore::store(const QString& path) {
+    QFile source(path);
+    if (!source.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const quint64* gear = gearTable();
+    quint64 fingerprint = 0;
+    qint64 total = 0;
+    bool ok = true;
+
+    QList<BlockRef> blocks;
+    QByteArray buffer(READ_BUFFER_SIZE, Qt::Uninitialized);
+    QByteArray block;
+    block.reserve(MAX_BLOCK_SIZE);
+
+    while (ok) {
+        qint64 read = source.read(buffer.data(), buffer.size());
+        if (read <= 0) {
+            ok = read == 0;
+            break;
+        }
+        total += read;
+
+        const uchar* data = reinterpret_cast<const uchar*>(buffer.constData());
+        int start = 0;
+        for (int i = 0; i < int(read) && ok; i++) {
+            fingerprint = (fingerprint << 1) + gear[data[i]];
+
+            int length = block.size() + i - start + 1;
+            if ((length >= MIN_BLOCK_SIZE && (fingerprint & BOUNDARY_MASK) == 0) || length >= MAX_BLOCK_SIZE) {
+                block.append(buffer.constData() + start, i - start + 1);
+                ok = put(block, blocks);
+                block.resize(0);
+                fingerprint = 0;
+                start = i + 1;
+            }
+        }
+        block.append(buffer.constData() + start, int(read) - start);
+    }
+
+    if (ok && !block.isEmpty()) {
+        ok = put(block, blocks);
+    }
+    source.close();
+
+    // The data is replaced by its manifest in one rename.
+    if (ok) {
+        QByteArray body;
+        foreach (const BlockRef& ref, blocks) {
+            body.append(ref.hash + ' ' + QByteArray::number(ref.size) + '\n');
+        }
+
+        QSaveFile manifest(path);
+        ok = !key.isEmpty() && manifest.open(QIODevice::WriteOnly);
+        if (ok) {
+            manifest.write(MANIFEST_MAGIC + QByteArray::number(total) + ' ' + sign(total, body) + '\n');
+            manifest.write(body);
+            ok = manifest.commit();
+        }
+    }
+
+    if (!ok) {
+        release(blocks);
+    }
+
+    return ok;
+}
+
+bool BlockStore::remove(const QString& path) {
+    // Moved aside first under a name only this call knows, so what it reads is exactly what it
+    // removes. A delete or commit of the same path on another worker has its own version to release.
+    QFileInfo info(path);
+    QString claimed = info.dir().filePath(QString(".") + info.fileName() + "." + QString::number(QRandomGenerator::global()->generate64(), 16) + ".removing");
+    if (!QDir().rename(path, claimed)) {
+        return false;
+    }
+
+    QHash<QString, QList<BlockRef>> manifests;
+    QList<BlockRef> blocks;
+    qint64 size;
+
+    bool dir = QFileInfo(claimed).isDir();
+    if (dir) {
+        QDirIterator files(claimed, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+        while (files.hasNext()) {
+            QString file = files.next();
+            if (readManifest(file, blocks, size)) {
+                manifests.insert(file, blocks);
+            }
+        }
+    } else if (readManifest(claimed, blocks, size)) {
+        manifests.insert(claimed, blocks);
+    }
+
+    bool removed = dir ? QDir(claimed).removeRecursively() : QFile(claimed).remove();
+
+    // A folder may go only in part, just the manifests that are gone give up their blocks.
+    QHash<QString, QList<BlockRef>>::const_iterator it;
+    for (it = manifests.constBegin(); it != manifests.constEnd(); ++it) {
+        if (!QFileInfo::exists(it.key())) {
+            release(it.value());
+        }
+    }
+
+    if (!removed && !QFileInfo::exists(path)) {
+        QDir().rename(claimed, path);
+    }
+
+    return removed;
+}
+
+int BlockStore::collect() {
+    // Listed without the lock, blocks written meanwhile are not candidates anyway.
+    QStringList candidates;
+    QDirIterator blocks(blocksPath, QDir::Files, QDirIterator::Subdirectories);
+    while (blocks.hasNext()) {
+        candidates.append(blocks.next());
+    }
+
+    QMutexLocker locker(&mutex);
+
+    int removed = 0;
+    foreach (const QString& path, candidates) {
+        QFileInfo info(path);
+        if (refs.contains(info.fileName().toLatin1())) {
+            continue;
+        }
+
+        qint64 size = info.size();
+        if (QFile::remove(path)) {
+            storedBytes -= size;
+            removed++;
+        }
+    }
+
+    return removed;
+}
+
+BlockStats BlockStore::stats() {
+    QMutexLocker locker(&mutex);
+
+    BlockStats stats;
+    stats.blocks = refs.size();
+    stats.referencedBytes = referencedBytes;
+    stats.storedBytes = storedBytes;
+    return stats;
+}
+
+QIODevice* BlockStore::reader(const QString& path) const {
+    QList<BlockRef> blocks;
+    qint64 size;
+    if (!readManifest(path, blocks, size)) {
+        return nullptr;
+    }
+
+    return new BlockReader(this, path);
+}
+
+qint64 BlockStore::size(const QString& path) const {
+    QList<BlockRef> blocks;
+    qint64 size;
+    if (readManifest(path, blocks, size)) {
+        return size;
+    }
+
+    return QFileInfo(path).size();
+}
+
+QString BlockStore::blockPath(const QByteArray& hash) const {
+    QString name = QString::fromLatin1(hash);
+    return blocksPath + QDir::separator() + name.left(2) + QDir::separator() + name;
+}
+
+bool BlockStore::readManifest(const QString& path, QList<BlockRef>& blocks, qint64& size) const {
+    QFile file(path);
+    if (key.isEmpty() || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QByteArray header = file.readLine(MANIFEST_MAGIC.size() + 128);
+    if (!header.startsWith(MANIFEST_MAGIC)) {
+        return false;
+    }
+
+    // Only what this store signed is a manifest, whatever else starts with the magic is file data.
+    // A body longer than the blocks of the claimed size could need is not even read.
+    QList<QByteArray> values = header.mid(MANIFEST_MAGIC.size()).trimmed().split(' ');
+    bool valid = false;
+    size = values.size() == 2 ? values[0].toLongLong(&valid) : -1;
+    if (!valid || size < 0 || file.size() - file.pos() > (size / MIN_BLOCK_SIZE + 1) * (HASH_HEX_SIZE + 22)) {
+        return false;
+    }
+
+    QByteArray body = file.readAll();
+    if (!sameDigest(values[1], sign(size, body))) {
+        return false;
+    }
+
+    blocks.clear();
+    qint64 total = 0;
+    foreach (const QByteArray& line, body.split('\n')) {
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        QList<QByteArray> fields = line.split(' ');
+        if (fields.size() != 2 || fields[0].size() != HASH_HEX_SIZE) {
+            return false;
+        }
+
+        bool ok = false;
+        BlockRef ref;
+        ref.hash = fields[0];
+        ref.size = fields[1].toLongLong(&ok);
+        if (!ok || ref.size <= 0) {
+            return false;
+        }
+
+        total += ref.size;
+        blocks.append(ref);
+    }
+
+    return total == size;
+}
+
+bool BlockStore::put(const QByteArray& block, QList<BlockRef>& blocks) {
+    QByteArray hash = QCryptographicHash::hash(block, QCryptographicHash::Sha256).toHex();
+
+    QMutexLocker locker(&mutex);
+
+    // A block nothing refers to any more stays on disk until the next collection.
+    if (!refs.contains(hash)) {
+        QString path = blockPath(hash);
+        if (!QFileInfo::exists(path)) {
+            QDir().mkpath(QFileInfo(path).path());
+
+            QSaveFile file(path);
+            if (!file.open(QIODevice::WriteOnly) || file.write(block) != block.size() || !file.commit()) {
+                return false;
+            }
+            storedBytes += block.size();
+        }
+    }
+
+    refs[hash]++;
+    referencedBytes += block.size();
+
+    BlockRef ref;
+    ref.hash = hash;
+    ref.size = block.size();
+    blocks.append(ref);
+    return true;
+}
+
+void BlockStore::loadKey(const QString& keyPath) {
+    QFile file(keyPath);
+    if (file.open(QIODevice::ReadOnly)) {
+        key = file.readAll();
+        if (key.size() == KEY_SIZE) {
+            return;
+        }
+    }
+
+    // Made once, with the store. Without it no manifest can be read or written.
+    key = QByteArray(KEY_SIZE, Qt::Uninitialized);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(key.data()), KEY_SIZE / int(sizeof(quint32)));
+
+    QSaveFile save(keyPath);
+    if (QFileInfo::exists(keyPath) || !save.open(QIODevice::WriteOnly) || save.write(key) != key.size() || !save.commit()) {
+        key.clear();
+        return;
+    }
+    QFile::setPermissions(keyPath, QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+}
+
+QByteArray BlockStore::sign(qint64 size, const QByteArray& body) const {
+    QMessageAuthenticationCode mac(QCryptographicHash::Sha256, key);
+    mac.addData(QByteArray::number(size) + '\n');
+    mac.addData(body);
+    return mac.result().toHex();
+}
+
+void BlockStore::reference(const QList<BlockRef>& blocks) {
+    QMutexLocker locker(&mutex);
+
+    foreach (const BlockRef& ref, blocks) {
+        refs[ref.hash]++;
+        referencedBytes += ref.size;
+    }
+}
+
+void BlockStore::release(const QList<BlockRef>& blocks) {
+    QMutexLocker locker(&mutex);
+
+    foreach (const BlockRef& ref, blocks) {
+        QHash<QByteArray, int>::iterator it = refs.find(ref.hash);
+        if (it == refs.end()) {
+            continue;
+        }
+
+        referencedBytes -= ref.size;
+        if (--it.value() == 0) {
+            refs.erase(it);
+        }
+    }
+}
+
+BlockReader::BlockReader(const BlockStore* store, const QString& manifestPath)
+    : QIODevice(), store(store), manifestPath(manifestPath), total(0), current(-1) {
+
+}
+
+bool BlockReader::open(OpenMode mode) {
+    if (mode & QIODevice::WriteOnly) {
+        return false;
+    }
+
+    if (!store->readManifest(manifestPath, blocks, total)) {
+        setErrorString("Invalid block manifest");
+        return false;
+    }
+
+    offsets.clear();
+    offsets.reserve(blocks.size());
+    qint64 offset = 0;
+    foreach (const BlockRef& ref, blocks) {
+        offsets.append(offset);
+        offset += ref.size;
+    }
+
+    current = -1;
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+void BlockReader::close() {
+    block.close();
+    current = -1;
+    QIODevice::close();
+}
+
+bool BlockReader::isSequential() const {
+    return false;
+}
+
+qint64 BlockReader::size() const {
+    return total;
+}
+
+qint64 BlockReader::readData(char* data, qint64 maxSize) {
+    qint64 position = pos();
+    if (position >= total) {
+        return 0;
+    }
+
+    int index = int(std::upper_bound(offsets.constBegin(), offsets.constEnd(), position) - offsets.constBegin()) - 1;
+    qint64 done = 0;
+
+    while (done < maxSize && index < blocks.size()) {
+        if (current != index) {
+            block.close();
+            block.setFileName(store->blockPath(blocks.at(index).hash));
+            if (!block.open(QIODevice::ReadOnly)) {
+                current = -1;
+                setErrorString(block.errorString());
+                return done > 0 ? done : -1;
+            }
+            current = index;
+        }
+
+        qint64 within = position - offsets.at(index);
+        if (!block.seek(within)) {
+            return done > 0 ? done : -1;
+        }
+
+        qint64 read = block.read(data + done, qMin(maxSize - done, blocks.at(index).size - within));
+        if (read <= 0) {
+            return done > 0 ? done : -1;
+        }
+
+        done += read;
+        position += read;
+        if (position >= offsets.at(index) + blocks.at(index).size) {
+            index++;
+        }
+    }
+
+    return done;
+}
+
+qint64 BlockReader::writeData(const char* data, qint64 maxSize) {
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+
+    return -1;
+}
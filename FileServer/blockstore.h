@@ -0,0 +1,85 @@
+#ifndef BLOCKSTORE_H
+#define BLOCKSTORE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QMutex>
+#include <QFile>
+#include <QIODevice>
+
+struct BlockRef {
+    QByteArray hash;
+    qint64 size;
+};
+
+struct BlockStats {
+    qint64 blocks;
+    qint64 referencedBytes;
+    qint64 storedBytes;
+};
+
+// Deduplicated storage: uploaded files are cut into content-defined blocks, each kept
+// once under blocks/<hash>, and the file under data/ is replaced by a manifest listing
+// them. Reference counts are rebuilt from the manifests at startup and kept in memory.
+// Manifests carry an HMAC under a key only the server knows, so no file a user could
+// have written, or one stored before the store was on, is ever taken for one.
+class BlockStore {
+public:
+    BlockStore(const QString& blocksPath, const QString& dataPath, const QString& keyPath);
+
+    void rebuild();
+    bool store(const QString& path);
+    bool remove(const QString& path);
+    int collect();
+    BlockStats stats();
+
+    QIODevice* reader(const QString& path) const;
+    qint64 size(const QString& path) const;
+    QString blockPath(const QByteArray& hash) const;
+
+    bool readManifest(const QString& path, QList<BlockRef>& blocks, qint64& size) const;
+
+private:
+    void loadKey(const QString& keyPath);
+    QByteArray sign(qint64 size, const QByteArray& body) const;
+    bool put(const QByteArray& block, QList<BlockRef>& blocks);
+    void reference(const QList<BlockRef>& blocks);
+    void release(const QList<BlockRef>& blocks);
+
+    QString blocksPath;
+    QString dataPath;
+    QByteArray key;
+    QHash<QByteArray, int> refs;
+    qint64 referencedBytes;
+    qint64 storedBytes;
+    QMutex mutex;
+};
+
+// Reads a manifest's blocks back as one seekable file.
+class BlockReader : public QIODevice {
+public:
+    BlockReader(const BlockStore* store, const QString& manifestPath);
+
+    bool open(OpenMode mode) override;
+    void close() override;
+    bool isSequential() const override;
+    qint64 size() const override;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+    qint64 writeData(const char* data, qint64 maxSize) override;
+
+private:
+    const BlockStore* store;
+    QString manifestPath;
+    QList<BlockRef> blocks;
+    QVector<qint64> offsets;
+    qint64 total;
+    QFile block;
+    int current;
+};
+
+#endif // !BLOCKSTORE_H
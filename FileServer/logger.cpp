@@ -0,0 +1,251 @@
+#include "logger.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QDir>
+#include <QMutexLocker>
+
+#include <cstring>
+
+static const char* LEVEL_NAMES[] = { "DEBUG", "INFO", "WARNING", "ERROR", "OFF" };
+static const char* COMPONENT_NAMES[] = { "server", "network", "auth", "storage", "transfer" };
+
+LogRing::LogRing() : head(0), tail(0) {
+    for (int i = 0; i < LOG_RING_SIZE; i++) {
+        cells[i].sequence.store(quint64(i), std::memory_order_relaxed);
+    }
+}
+
+bool LogRing::push(const LogEvent& event) {
+    quint64 pos = head.load(std::memory_order_relaxed);
+    forever {
+        Slot& slot = cells[pos % LOG_RING_SIZE];
+        quint64 sequence = slot.sequence.load(std::memory_order_acquire);
+        qint64 diff = qint64(sequence) - qint64(pos);
+        if (diff == 0) {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot.event = event;
+                slot.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool LogRing::pop(LogEvent& event) {
+    Slot& slot = cells[tail % LOG_RING_SIZE];
+    if (slot.sequence.load(std::memory_order_acquire) != tail + 1) {
+        return false;
+    }
+
+    event = slot.event;
+    slot.sequence.store(tail + LOG_RING_SIZE, std::memory_order_release);
+    tail++;
+    return true;
+}
+
+bool LogRing::isEmpty() const {
+    return cells[tail % LOG_RING_SIZE].sequence.load(std::memory_order_acquire) != tail + 1;
+}
+
+Logger::Logger(const QString& filePath, qint64 maxFileSize, int maxFiles, QObject* parent)
+    : QThread(parent), filePath(filePath), maxFileSize(maxFileSize), maxFiles(maxFiles), dropped(0), stopping(false), sleeping(false) {
+    for (int i = 0; i < LogComponentCount; i++) {
+        levels[i].store(LogInfo, std::memory_order_relaxed);
+    }
+}
+
+Logger::~Logger() {
+    stopping.store(true, std::memory_order_seq_cst);
+    {
+        QMutexLocker locker(&wakeMutex);
+        wake.wakeOne();
+    }
+    wait();
+}
+
+bool Logger::isEnabled(LogComponent component, LogLevel level) const {
+    return level >= levels[component].load(std::memory_order_relaxed);
+}
+
+void Logger::setLevel(LogComponent component, LogLevel level) {
+    levels[component].store(level, std::memory_order_relaxed);
+}
+
+bool Logger::setLevels(const QString& spec) {
+    // "info,transfer=debug": a bare level applies to every component, name=level to one.
+    foreach (const QString& entry, spec.split(",", Qt::SkipEmptyParts)) {
+        QStringList pair = entry.trimmed().split("=");
+        QString levelName = pair.last().trimmed().toUpper();
+
+        int level = -1;
+        for (int i = LogDebug; i <= LogOff; i++) {
+            if (levelName == LEVEL_NAMES[i]) {
+                level = i;
+            }
+        }
+        if (level < 0) {
+            return false;
+        }
+
+        if (pair.size() == 1) {
+            for (int i = 0; i < LogComponentCount; i++) {
+                setLevel(LogComponent(i), LogLevel(level));
+            }
+            continue;
+        }
+
+        int component = -1;
+        for (int i = 0; i < LogComponentCount; i++) {
+            if (pair.first().trimmed() == COMPONENT_NAMES[i]) {
+                component = i;
+            }
+        }
+        if (component < 0) {
+            return false;
+        }
+
+        setLevel(LogComponent(component), LogLevel(level));
+    }
+
+    return true;
+}
+
+void Logger::log(LogLevel level, LogComponent component, qint64 sockd, const char* what, const char* message, QStringView detail, qint64 arg1, qint64 arg2, qint64 arg3) {
+    if (!isEnabled(component, level)) {
+        return;
+    }
+
+    LogEvent event;
+    event.time = QDateTime::currentMSecsSinceEpoch();
+    event.sockd = sockd;
+    event.args[0] = arg1;
+    event.args[1] = arg2;
+    event.args[2] = arg3;
+    event.what = what;
+    event.message = message;
+    event.level = quint8(level);
+    event.component = quint8(component);
+    event.detailSize = quint16(qMin<qsizetype>(detail.size(), LOG_DETAIL_SIZE));
+    std::memcpy(event.detail, detail.utf16(), event.detailSize * sizeof(char16_t));
+
+    if (!ring.push(event)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Ordered after the push, so either the writer sees the event before it sleeps or this sees it asleep.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed)) {
+        QMutexLocker locker(&wakeMutex);
+        sleeping.store(false, std::memory_order_relaxed);
+        wake.wakeOne();
+    }
+}
+
+void Logger::run() {
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+
+    QFile file(filePath);
+    file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+
+    quint64 reportedDropped = 0;
+    QStringList batch;
+    LogEvent event;
+
+    forever {
+        bool stop = stopping.load(std::memory_order_acquire);
+
+        int count = 0;
+        while (ring.pop(event)) {
+            QString line = format(event);
+            file.write(line.toUtf8());
+            file.write("\n");
+            batch.append(line);
+            count++;
+
+            if (batch.size() >= 256) {
+                emit linesWritten(batch);
+                batch.clear();
+            }
+        }
+
+        quint64 totalDropped = dropped.load(std::memory_order_relaxed);
+        if (totalDropped != reportedDropped) {
+            QString line = QString("%1 WARNING server %2 log events dropped, ring buffer full")
+                    .arg(QDateTime::currentDateTime().toString(Qt::ISODateWithMs)).arg(totalDropped - reportedDropped);
+            file.write(line.toUtf8());
+            file.write("\n");
+            batch.append(line);
+            reportedDropped = totalDropped;
+        }
+
+        if (!batch.isEmpty()) {
+            emit linesWritten(batch);
+            batch.clear();
+        }
+
+        if (count > 0) {
+            file.flush();
+            if (file.size() >= maxFileSize) {
+                rotate(file);
+            }
+        }
+
+        if (stop) {
+            break;
+        }
+
+        // Checked again once marked asleep, an event pushed meanwhile has seen the mark and waits
+        // on the mutex until this is waiting.
+        if (count == 0) {
+            QMutexLocker locker(&wakeMutex);
+            sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ring.isEmpty() && !stopping.load(std::memory_order_seq_cst)) {
+                wake.wait(&wakeMutex);
+            }
+            sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+}
+
+QString Logger::format(const LogEvent& event) const {
+    QString text = QString::fromLatin1(event.message ? event.message : "");
+    for (int i = 0; i < 3; i++) {
+        QString marker = QString("%") + QString::number(i + 1);
+        if (text.contains(marker)) {
+            text.replace(marker, QString::number(event.args[i]));
+        }
+    }
+
+    if (event.detailSize > 0) {
+        if (!text.isEmpty()) {
+            text.append(" ");
+        }
+        text.append(QString::fromUtf16(event.detail, event.detailSize));
+    }
+
+    return QString("%1 %2 %3 %4::%5: %6")
+            .arg(QDateTime::fromMSecsSinceEpoch(event.time).toString(Qt::ISODateWithMs))
+            .arg(LEVEL_NAMES[event.level])
+            .arg(COMPONENT_NAMES[event.component])
+            .arg(event.sockd)
+            .arg(event.what)
+            .arg(text);
+}
+
+void Logger::rotate(QFile& file) {
+    file.close();
+
+    QFile::remove(QString("%1.%2").arg(filePath).arg(maxFiles - 1));
+    for (int i = maxFiles - 2; i >= 1; i--) {
+        QFile::rename(QString("%1.%2").arg(filePath).arg(i), QString("%1.%2").arg(filePath).arg(i + 1));
+    }
+    QFile::rename(filePath, QString("%1.1").arg(filePath));
+
+    file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+}
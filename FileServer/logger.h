@@ -0,0 +1,105 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <QThread>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <atomic>
+
+enum LogLevel {
+    LogDebug,
+    LogInfo,
+    LogWarning,
+    LogError,
+    LogOff,
+};
+
+enum LogComponent {
+    LogServer,
+    LogNetwork,
+    LogAuth,
+    LogStorage,
+    LogTransfer,
+    LogComponentCount,
+};
+
+static const int LOG_DETAIL_SIZE = 120;
+static const int LOG_RING_SIZE = 4096;
+
+// Plain data only: message is a string literal whose %1..%3 are filled from the args by the writer thread.
+struct LogEvent {
+    qint64 time;
+    qint64 sockd;
+    qint64 args[3];
+    const char* what;
+    const char* message;
+    quint8 level;
+    quint8 component;
+    quint16 detailSize;
+    char16_t detail[LOG_DETAIL_SIZE];
+};
+
+// Bounded multi-producer, single-consumer queue. A full ring drops the event instead of blocking.
+class LogRing {
+public:
+    LogRing();
+
+    bool push(const LogEvent& event);
+    bool pop(LogEvent& event);
+    bool isEmpty() const;
+
+private:
+    struct Slot {
+        std::atomic<quint64> sequence;
+        LogEvent event;
+    };
+
+    Slot cells[LOG_RING_SIZE];
+    alignas(64) std::atomic<quint64> head;
+    alignas(64) quint64 tail;
+};
+
+class Logger : public QThread {
+    Q_OBJECT
+
+public:
+    Logger(const QString& filePath, qint64 maxFileSize = 8 * 1024 * 1024, int maxFiles = 5, QObject* parent = nullptr);
+    ~Logger();
+
+    bool isEnabled(LogComponent component, LogLevel level) const;
+    void setLevel(LogComponent component, LogLevel level);
+    bool setLevels(const QString& spec);
+
+    void log(LogLevel level, LogComponent component, qint64 sockd, const char* what, const char* message, QStringView detail = QStringView(), qint64 arg1 = 0, qint64 arg2 = 0, qint64 arg3 = 0);
+
+signals:
+    void linesWritten(const QStringList& lines);
+
+protected:
+    void run() override;
+
+private:
+    QString format(const LogEvent& event) const;
+    void rotate(QFile& file);
+
+    QString filePath;
+    qint64 maxFileSize;
+    int maxFiles;
+
+    LogRing ring;
+    std::atomic<int> levels[LogComponentCount];
+    std::atomic<quint64> dropped;
+    std::atomic<bool> stopping;
+
+    // The writer sleeps on an empty ring, the producer that finds it asleep wakes it.
+    std::atomic<bool> sleeping;
+    QMutex wakeMutex;
+    QWaitCondition wake;
+};
+
+#endif // !LOGGER_H
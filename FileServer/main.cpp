@@ -1,10 +1,28 @@
 #include "mainwindow.h"
 
 #include <QApplication>
+#include <QMessageBox>
+
+#include "server.h"
+#include "serverconfig.h"
 
 int main(int argc, char* argv[]) {
     QApplication a(argc, argv);
-    MainWindow w;
+
+    ServerConfig config;
+    QString error;
+    if (!parseServerConfig(a.arguments(), config, error)) {
+        QMessageBox::information(nullptr, "File Server", error);
+        return EXIT_FAILURE;
+    }
+
+    Server server(config);
+    MainWindow w(&server);
+    if (!server.start()) {
+        QMessageBox::critical(&w, "QTcpServer", QString("Unable to start the server: %1.").arg(server.errorString()));
+        return EXIT_FAILURE;
+    }
+
     w.show();
     return a.exec();
 }
@@ -0,0 +1,262 @@
+#include "metadatacache.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QMutexLocker>
+
+#include "blockstore.h"
+
+MetadataCache::MetadataCache(const QString& dataPath, BlockStore* blocks) : dataPath(dataPath), blocks(blocks) {
+
+}
+
+MetadataCache::~MetadataCache() {
+    foreach (UserTree* userTree, trees) {
+        release(userTree->root);
+        delete userTree;
+    }
+}
+
+QJsonObject MetadataCache::listing(const QString& username) {
+    UserTree* userTree = tree(username);
+    QMutexLocker locker(&userTree->mutex);
+
+    if (!userTree->root) {
+        userTree->root = load(dataPath + QDir::separator() + username);
+    }
+
+    return toJson(userTree->root, username);
+}
+
+QJsonObject MetadataCache::listing(const QString& path, int depth, const QString& cursor, int limit) {
+    QStringList parts = split(path);
+    if (parts.isEmpty()) {
+        return QJsonObject();
+    }
+
+    UserTree* userTree = tree(parts.first());
+    QMutexLocker locker(&userTree->mutex);
+
+    if (!userTree->root) {
+        userTree->root = load(dataPath + QDir::separator() + parts.first());
+    }
+
+    MetadataNode* node = find(userTree->root, parts);
+    if (!node || !node->dir) {
+        return QJsonObject();
+    }
+
+    QJsonObject object = toJson(node, path, 0);
+    object.insert("total", node->children.size());
+    if (!cursor.isEmpty()) {
+        object.insert("cursor", cursor);
+    }
+
+    // The cursor is the last entry sent ("d/<name>" or "f/<name>"), so entries added or
+    // removed between two pages neither shift nor repeat the rest of the listing.
+    int pass = 0;
+    QMap<QString, MetadataNode*>::const_iterator it = node->children.constBegin();
+    if (!cursor.isEmpty()) {
+        pass = cursor.startsWith("d/") ? 0 : 1;
+        it = node->children.upperBound(cursor.mid(2));
+    }
+
+    QJsonArray children;
+    QString last;
+    for (; pass < 2; pass++) {
+        for (; it != node->children.constEnd(); ++it) {
+            const MetadataNode* child = it.value();
+            if (child->dir != (pass == 0)) {
+                continue;
+            }
+
+            if (limit > 0 && children.size() == limit) {
+                object.insert("next", last);
+                object.insert("children", children);
+                return object;
+            }
+
+            children.push_back(toJson(child, path + QDir::separator() + child->name, depth - 1));
+            last = QString(child->dir ? "d/" : "f/") + child->name;
+        }
+        it = node->children.constBegin();
+    }
+
+    object.insert("children", children);
+    return object;
+}
+
+QJsonObject MetadataCache::addEntry(const QString& path, bool dir, qint64 size, qint64 modified) {
+    QStringList parts = split(path);
+
+    MetadataNode entry;
+    entry.name = parts.value(parts.size() - 1);
+    entry.dir = dir;
+    entry.size = dir ? 0 : size;
+    entry.modified = modified;
+
+    // Listed as it is now: a new folder is always empty.
+    QJsonObject object = toJson(&entry, path);
+    if (parts.size() < 2) {
+        return object;
+    }
+
+    UserTree* userTree = tree(parts.first());
+    QMutexLocker locker(&userTree->mutex);
+
+    // Not loaded yet, the first listing will pick the entry up from disk.
+    if (!userTree->root) {
+        return object;
+    }
+
+    QString name = parts.takeLast();
+    MetadataNode* parent = find(userTree->root, parts);
+    if (!parent || !parent->dir) {
+        release(userTree->root);
+        userTree->root = nullptr;
+        return object;
+    }
+
+    MetadataNode* node = parent->children.value(name, nullptr);
+    if (node && node->dir != dir) {
+        release(node);
+        node = nullptr;
+    }
+    if (!node) {
+        node = new MetadataNode();
+        node->name = name;
+        parent->children.insert(name, node);
+    }
+
+    node->dir = entry.dir;
+    node->size = entry.size;
+    node->modified = entry.modified;
+
+    return object;
+}
+
+void MetadataCache::removeEntry(const QString& path) {
+    QStringList parts = split(path);
+    if (parts.size() < 2) {
+        invalidate(parts.value(0));
+        return;
+    }
+
+    UserTree* userTree = tree(parts.first());
+    QMutexLocker locker(&userTree->mutex);
+
+    if (!userTree->root) {
+        return;
+    }
+
+    QString name = parts.takeLast();
+    MetadataNode* parent = find(userTree->root, parts);
+    if (parent) {
+        release(parent->children.take(name));
+    }
+}
+
+void MetadataCache::invalidate(const QString& username) {
+    if (username.isEmpty()) {
+        return;
+    }
+
+    UserTree* userTree = tree(username);
+    QMutexLocker locker(&userTree->mutex);
+
+    release(userTree->root);
+    userTree->root = nullptr;
+}
+
+MetadataCache::UserTree* MetadataCache::tree(const QString& username) {
+    QMutexLocker locker(&treesMutex);
+
+    UserTree* userTree = trees.value(username, nullptr);
+    if (!userTree) {
+        userTree = new UserTree();
+        userTree->root = nullptr;
+        trees.insert(username, userTree);
+    }
+
+    return userTree;
+}
+
+MetadataNode* MetadataCache::load(const QString& path) {
+    QFileInfo info(path);
+
+    MetadataNode* node = new MetadataNode();
+    node->name = info.fileName();
+    node->dir = info.isDir();
+    node->size = node->dir ? 0 : (blocks ? blocks->size(path) : info.size());
+    node->modified = info.lastModified().toMSecsSinceEpoch();
+
+    if (node->dir) {
+        QDir dir(path);
+        foreach (const QFileInfo& file, dir.entryInfoList(QDir::NoDotAndDotDot | QDir::AllEntries)) {
+            if (file.fileName().startsWith(".") && (file.fileName().endsWith(".part") || file.fileName().endsWith(".part.id"))) {
+                continue;
+            }
+            node->children.insert(file.fileName(), load(file.filePath()));
+        }
+    }
+
+    return node;
+}
+
+MetadataNode* MetadataCache::find(MetadataNode* root, const QStringList& parts) {
+    MetadataNode* node = root;
+    for (int i = 1; i < parts.size() && node; i++) {
+        node = node->children.value(parts.at(i), nullptr);
+    }
+
+    return node;
+}
+
+QJsonObject MetadataCache::toJson(const MetadataNode* node, const QString& path, int depth) const {
+    QJsonObject object;
+    object.insert("name", node->name);
+    object.insert("path", path);
+    object.insert("modified", node->modified);
+
+    if (node->dir) {
+        object.insert("type", "dir");
+
+        // Folders below the requested depth go out without "children" and are listed when opened.
+        if (depth == 0) {
+            return object;
+        }
+
+        // Folders first, then by name, as the listing used to come from QDir.
+        QJsonArray children;
+        for (int pass = 0; pass < 2; pass++) {
+            foreach (const MetadataNode* child, node->children) {
+                if (child->dir == (pass == 0)) {
+                    children.push_back(toJson(child, path + QDir::separator() + child->name, depth - 1));
+                }
+            }
+        }
+        object.insert("children", children);
+    } else {
+        object.insert("type", "file");
+        object.insert("size", node->size);
+    }
+
+    return object;
+}
+
+void MetadataCache::release(MetadataNode* node) {
+    if (!node) {
+        return;
+    }
+
+    foreach (MetadataNode* child, node->children) {
+        release(child);
+    }
+    delete node;
+}
+
+QStringList MetadataCache::split(const QString& path) {
+    return QDir::cleanPath(QDir::fromNativeSeparators(path)).split("/", Qt::SkipEmptyParts);
+}
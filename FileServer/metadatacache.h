@@ -0,0 +1,55 @@
+#ifndef METADATACACHE_H
+#define METADATACACHE_H
+
+#include <QString>
+#include <QStringList>
+#include <QMap>
+#include <QHash>
+#include <QMutex>
+#include <QJsonObject>
+
+class BlockStore;
+
+struct MetadataNode {
+    QString name;
+    bool dir;
+    qint64 size;
+    qint64 modified;
+    QMap<QString, MetadataNode*> children;
+};
+
+// In-memory copy of each user's tree under the data folder. A tree is read from disk
+// the first time it is needed and afterwards only changed through the worker's mutations,
+// until it is dropped again with invalidate() once its user signs out.
+class MetadataCache {
+public:
+    MetadataCache(const QString& dataPath, BlockStore* blocks = nullptr);
+    ~MetadataCache();
+
+    QJsonObject listing(const QString& username);
+    QJsonObject listing(const QString& path, int depth, const QString& cursor, int limit);
+
+    QJsonObject addEntry(const QString& path, bool dir, qint64 size, qint64 modified);
+    void removeEntry(const QString& path);
+    void invalidate(const QString& username);
+
+private:
+    struct UserTree {
+        QMutex mutex;
+        MetadataNode* root;
+    };
+
+    UserTree* tree(const QString& username);
+    MetadataNode* load(const QString& path);
+    MetadataNode* find(MetadataNode* root, const QStringList& parts);
+    QJsonObject toJson(const MetadataNode* node, const QString& path, int depth = -1) const;
+    static void release(MetadataNode* node);
+    static QStringList split(const QString& path);
+
+    QString dataPath;
+    BlockStore* blocks;
+    QHash<QString, UserTree*> trees;
+    QMutex treesMutex;
+};
+
+#endif // !METADATACACHE_H
@@ -0,0 +1,382 @@
+#include "server.h"
+
+#include <QDir>
+#include <QMutexLocker>
+#include <QFileInfo>
+#include <QTimer>
+#include <QRandomGenerator>
+
+#ifdef Q_OS_LINUX
+#include <signal.h>
+#endif
+
+#include "worker.h"
+#include "logger.h"
+#include "metadatacache.h"
+#include "accountstore.h"
+#include "blockstore.h"
+
+static const int BLOCK_COLLECT_INTERVAL = 60 * 60 * 1000;
+
+Server::Server(const ServerConfig& config, QObject* parent) : QTcpServer(parent), serverConfig(config), nextWorker(0) {
+    qRegisterMetaType<qintptr>("qintptr");
+
+    QDir().mkpath(dataPath());
+    QDir().mkpath(trashPath());
+
+    QString logFile = serverConfig.logFile;
+    if (logFile.isEmpty()) {
+        logFile = QDir(serverConfig.root).filePath("logs/fileserver.log");
+    }
+
+    serverLogger = new Logger(logFile);
+    serverLogger->start(QThread::LowPriority);
+    if (!serverLogger->setLevels(serverConfig.logLevels)) {
+        serverLogger->log(LogWarning, LogServer, -1, "Server", "Invalid log level spec", serverConfig.logLevels);
+    }
+
+    // Once blocks exist the data folder holds manifests, so the store stays on from then on.
+    blockStore = nullptr;
+    QString blocksPath = QDir::cleanPath(serverConfig.root + QDir::separator() + "blocks");
+    if (serverConfig.dedup || QFileInfo::exists(blocksPath)) {
+        QDir().mkpath(blocksPath);
+        blockStore = new BlockStore(blocksPath, dataPath(), QDir::cleanPath(serverConfig.root + QDir::separator() + "blocks.key"));
+        blockStore->rebuild();
+    }
+
+    metadataCache = new MetadataCache(dataPath(), blockStore);
+
+    QDir root(serverConfig.root);
+    accountStore = new AccountStore(root.filePath("accounts.journal"), root.filePath("accounts.data"));
+    if (!accountStore->open()) {
+        serverLogger->log(LogError, LogAuth, -1, "Server", "Cannot open the account store", accountStore->errorString());
+    } else if (accountStore->migratedCount() > 0) {
+        serverLogger->log(LogInfo, LogAuth, -1, "Server", "Migrated %1 accounts to", root.filePath("accounts.journal"), accountStore->migratedCount());
+    }
+}
+
+Server::~Server() {
+    close();
+
+    // Finished signatures are handed to their workers, which have to be still there.
+    signaturePool.waitForDone();
+
+    foreach (QThread* thread, threads) {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+
+    collector.waitForDone();
+
+    delete accountStore;
+    delete metadataCache;
+    delete blockStore;
+    delete serverLogger;
+}
+
+bool Server::start() {
+    if (!listen(QHostAddress::Any, serverConfig.port)) {
+        return false;
+    }
+
+    bool zeroCopy = false;
+#ifdef Q_OS_LINUX
+    // sendfile() raises SIGPIPE on a reset peer, QTcpSocket's own writes already use MSG_NOSIGNAL.
+    zeroCopy = serverConfig.zeroCopy;
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    int threadCount = serverConfig.threads;
+    if (threadCount <= 0) {
+        threadCount = QThread::idealThreadCount();
+    }
+
+    for (int i = 0; i < threadCount; i++) {
+        QThread* thread = new QThread();
+        Worker* worker = new Worker(this, zeroCopy);
+        worker->moveToThread(thread);
+
+        connect(thread, &QThread::finished, worker, &QObject::deleteLater);
+
+        thread->start();
+
+        threads.append(thread);
+        workers.append(worker);
+    }
+
+    serverLogger->log(LogInfo, LogServer, -1, "start", "Listening on port %1 with %2 I/O threads, data in", QDir(dataPath()).absolutePath(), serverPort(), threadCount);
+
+    if (blockStore) {
+        collector.setMaxThreadCount(1);
+        collectBlocks();
+
+        QTimer* timer = new QTimer(this);
+        connect(timer, &QTimer::timeout, this, &Server::collectBlocks);
+        timer->start(BLOCK_COLLECT_INTERVAL);
+    }
+    return true;
+}
+
+const ServerConfig& Server::config() const {
+    return serverConfig;
+}
+
+Logger* Server::logger() const {
+    return serverLogger;
+}
+
+MetadataCache* Server::metadata() const {
+    return metadataCache;
+}
+
+BlockStore* Server::blocks() const {
+    return blockStore;
+}
+
+QThreadPool* Server::signatures() {
+    return &signaturePool;
+}
+
+QString Server::dataPath() const {
+    return QDir::cleanPath(serverConfig.root + QDir::separator() + "data");
+}
+
+QString Server::trashPath() const {
+    return QDir::cleanPath(serverConfig.root + QDir::separator() + "trash");
+}
+
+void Server::incomingConnection(qintptr socketDescriptor) {
+    Worker* worker = workers.at(nextWorker);
+    nextWorker = (nextWorker + 1) % workers.size();
+
+    QMetaObject::invokeMethod(worker, "addConnection", Qt::QueuedConnection, Q_ARG(qintptr, socketDescriptor));
+}
+
+bool Server::accountExists(const QString& username) {
+    QMutexLocker locker(&accountsMutex);
+    return accountStore->contains(username);
+}
+
+QString Server::accountPassword(const QString& username) {
+    QMutexLocker locker(&accountsMutex);
+    return accountStore->password(username);
+}
+
+bool Server::addAccount(const QString& username, const QString& password) {
+    QMutexLocker locker(&accountsMutex);
+    if (accountStore->add(username, password)) {
+        return true;
+    }
+
+    if (!accountStore->contains(username)) {
+        serverLogger->log(LogError, LogAuth, -1, "addAccount", "Cannot write the account store", accountStore->errorString());
+    }
+    return false;
+}
+
+bool Server::claimUser(const QString& username, ClientSession* session, QByteArray& token) {
+    QMutexLocker locker(&usersMutex);
+    if (users.contains(username)) {
+        return false;
+    }
+
+    quint32 random[4];
+    QRandomGenerator::system()->fillRange(random);
+    token = QByteArray(reinterpret_cast<const char*>(random), sizeof(random)).toHex();
+
+    SignedIn signedIn;
+    signedIn.session = session;
+    signedIn.token = token;
+    users.insert(username, signedIn);
+    tokens.insert(token, username);
+    return true;
+}
+
+void Server::releaseUser(const QString& username, ClientSession* session) {
+    {
+        QMutexLocker locker(&usersMutex);
+        QHash<QString, SignedIn>::iterator it = users.find(username);
+        if (it == users.end() || it.value().session != session) {
+            return;
+        }
+
+        tokens.remove(it.value().token);
+        users.erase(it);
+    }
+
+    // Split uploads belong to the session, nothing can attach to finish them once it is gone.
+    dropUserRanges(username);
+
+    // Only signed in users keep their tree in memory, the next sign in reads it from disk again.
+    metadataCache->invalidate(username);
+}
+
+QString Server::tokenUser(const QByteArray& token) {
+    QMutexLocker locker(&usersMutex);
+    return tokens.value(token);
+}
+
+bool Server::claimUpload(const QString& filePath) {
+    QMutexLocker locker(&uploadingMutex);
+    if (uploading.contains(filePath)) {
+        return false;
+    }
+
+    uploading.insert(filePath);
+    return true;
+}
+
+void Server::releaseUpload(const QString& filePath) {
+    QMutexLocker locker(&uploadingMutex);
+    uploading.remove(filePath);
+}
+
+bool Server::openRange(const QString& path, const QString& filePath, const QString& username) {
+    QMutexLocker locker(&rangesMutex);
+    QHash<QString, RangeFile>::iterator it = ranges.find(path);
+    if (it == ranges.end()) {
+        // The first range claims the file for the whole upload, as a session of its own would.
+        if (!claimUpload(filePath)) {
+            return false;
+        }
+
+        RangeFile file;
+        file.filePath = filePath;
+        file.username = username;
+        file.open = 0;
+        file.dropped = false;
+        it = ranges.insert(path, file);
+    } else if (it.value().dropped || it.value().filePath != filePath) {
+        return false;
+    }
+
+    it.value().open++;
+    return true;
+}
+
+void Server::closeRange(const QString& path) {
+    QMutexLocker locker(&rangesMutex);
+    QHash<QString, RangeFile>::iterator it = ranges.find(path);
+    if (it == ranges.end()) {
+        return;
+    }
+
+    if (--it.value().open <= 0 && it.value().dropped) {
+        releaseUpload(it.value().filePath);
+        ranges.erase(it);
+        QFile::remove(path);
+    }
+}
+
+void Server::addRange(const QString& path, qint64 start, qint64 end) {
+    QMutexLocker locker(&rangesMutex);
+    QHash<QString, RangeFile>::iterator file = ranges.find(path);
+    if (file == ranges.end()) {
+        return;
+    }
+    QMap<qint64, qint64>& written = file.value().written;
+
+    // Kept merged, so the map holds disjoint ranges that do not touch.
+    QMap<qint64, qint64>::iterator it = written.upperBound(start);
+    if (it != written.begin() && (it - 1).value() >= start) {
+        --it;
+        start = it.key();
+        end = qMax(end, it.value());
+        it = written.erase(it);
+    }
+    while (it != written.end() && it.key() <= end) {
+        end = qMax(end, it.value());
+        it = written.erase(it);
+    }
+    written.insert(start, end);
+}
+
+qint64 Server::rangeEnd(const QString& path, qint64 offset) {
+    QMutexLocker locker(&rangesMutex);
+    const QMap<qint64, qint64> written = ranges.value(path).written;
+
+    QMap<qint64, qint64>::const_iterator it = written.upperBound(offset);
+    if (it != written.constBegin() && (it - 1).value() >= offset) {
+        return (it - 1).value();
+    }
+
+    return offset;
+}
+
+bool Server::takeRanges(const QString& path, qint64& bytes) {
+    QMutexLocker locker(&rangesMutex);
+    bytes = -1;
+
+    // Not while another connection may still write into the file. Taken, the claim on the file
+    // stays with the caller until it is committed.
+    QHash<QString, RangeFile>::iterator it = ranges.find(path);
+    if (it == ranges.end()) {
+        return true;
+    }
+    if (it.value().open > 0) {
+        return false;
+    }
+
+    bytes = 0;
+    const QMap<qint64, qint64>& written = it.value().written;
+    for (QMap<qint64, qint64>::const_iterator range = written.constBegin(); range != written.constEnd(); ++range) {
+        bytes += range.value() - range.key();
+    }
+
+    ranges.erase(it);
+    return true;
+}
+
+void Server::cancelRanges(const QString& path) {
+    QMutexLocker locker(&rangesMutex);
+    QHash<QString, RangeFile>::iterator it = ranges.find(path);
+    if (it == ranges.end()) {
+        QFile::remove(path);
+        return;
+    }
+
+    it.value().dropped = true;
+    if (it.value().open <= 0) {
+        releaseUpload(it.value().filePath);
+        ranges.erase(it);
+        QFile::remove(path);
+    }
+}
+
+void Server::dropUserRanges(const QString& username) {
+    QMutexLocker locker(&rangesMutex);
+    QHash<QString, RangeFile>::iterator it = ranges.begin();
+    while (it != ranges.end()) {
+        if (it.value().username != username) {
+            ++it;
+            continue;
+        }
+
+        it.value().dropped = true;
+        if (it.value().open > 0) {
+            ++it;
+            continue;
+        }
+
+        releaseUpload(it.value().filePath);
+        QFile::remove(it.key());
+        it = ranges.erase(it);
+    }
+}
+
+void Server::collectBlocks() {
+    bool started = collector.tryStart([this]() {
+        int removed = blockStore->collect();
+        BlockStats stats = blockStore->stats();
+
+        // Bytes the files add up to against bytes actually on disk, in percent.
+        qint64 ratio = stats.storedBytes > 0 ? stats.referencedBytes * 100 / stats.storedBytes : 100;
+        serverLogger->log(LogInfo, LogStorage, -1, "collectBlocks", "%1 unused blocks removed, %2 in use", QStringView(), removed, stats.blocks);
+        serverLogger->log(LogInfo, LogStorage, -1, "collectBlocks", "%1 bytes in files, %2 bytes stored, dedup ratio %3%", QStringView(), stats.referencedBytes, stats.storedBytes, ratio);
+    });
+
+    if (!started) {
+        serverLogger->log(LogInfo, LogStorage, -1, "collectBlocks", "Still collecting, skipped");
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <QTcpServer>
+#include <QMutex>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QList>
+#include <QThread>
+#include <QThreadPool>
+
+#include "serverconfig.h"
+
+class Worker;
+class Logger;
+class MetadataCache;
+class AccountStore;
+class ClientSession;
+class BlockStore;
+
+class Server : public QTcpServer {
+    Q_OBJECT
+
+public:
+    Server(const ServerConfig& config, QObject* parent = nullptr);
+    ~Server();
+
+    bool start();
+
+    const ServerConfig& config() const;
+    Logger* logger() const;
+    MetadataCache* metadata() const;
+    BlockStore* blocks() const;
+    QThreadPool* signatures();
+    QString dataPath() const;
+    QString trashPath() const;
+
+    bool accountExists(const QString& username);
+    QString accountPassword(const QString& username);
+    bool addAccount(const QString& username, const QString& password);
+
+    bool claimUser(const QString& username, ClientSession* session, QByteArray& token);
+    void releaseUser(const QString& username, ClientSession* session);
+    QString tokenUser(const QByteArray& token);
+
+    bool claimUpload(const QString& filePath);
+    void releaseUpload(const QString& filePath);
+
+    bool openRange(const QString& path, const QString& filePath, const QString& username);
+    void closeRange(const QString& path);
+    void addRange(const QString& path, qint64 start, qint64 end);
+    qint64 rangeEnd(const QString& path, qint64 offset);
+    bool takeRanges(const QString& path, qint64& bytes);
+    void cancelRanges(const QString& path);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private slots:
+    void collectBlocks();
+
+private:
+    void dropUserRanges(const QString& username);
+
+    ServerConfig serverConfig;
+    Logger* serverLogger;
+    MetadataCache* metadataCache;
+    BlockStore* blockStore;
+
+    AccountStore* accountStore;
+    QMutex accountsMutex;
+
+    // Signed-in users across all workers. Sessions belong to their worker thread and are only
+    // compared here. The token lets further connections join a session, see RequestAttach.
+    struct SignedIn {
+        ClientSession* session;
+        QByteArray token;
+    };
+    QHash<QString, SignedIn> users;
+    QHash<QByteArray, QString> tokens;
+    QMutex usersMutex;
+
+    // Files with an upload writing their part file, whichever worker the connection is on.
+    QSet<QString> uploading;
+    QMutex uploadingMutex;
+
+    // Files uploaded over several connections, by temporary path: the file they are claimed
+    // for, the bytes written so far and how many connections have a range of it open. Once
+    // cancelled, or once the session it was uploaded in is gone, it is removed with its part
+    // file and claim as soon as none is open.
+    struct RangeFile {
+        QString filePath;
+        QMap<qint64, qint64> written;
+        QString username;
+        int open;
+        bool dropped;
+    };
+    QHash<QString, RangeFile> ranges;
+    QMutex rangesMutex;
+
+    // Block collection lists and deletes files for a while, it runs here and never twice at once.
+    QThreadPool collector;
+
+    // Signatures of stored files for delta uploads, made off the I/O threads.
+    QThreadPool signaturePool;
+
+    QList<QThread*> threads;
+    QList<Worker*> workers;
+    int nextWorker;
+};
+
+#endif // !SERVER_H
@@ -0,0 +1,78 @@
+#include "serverconfig.h"
+
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+
+bool parseServerConfig(const QStringList& arguments, ServerConfig& config, QString& error) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("File server");
+    parser.addHelpOption();
+
+    QCommandLineOption portOption(QStringList() << "p" << "port", "Port to listen on.", "port", QString::number(config.port));
+    QCommandLineOption rootOption(QStringList() << "r" << "root", "Directory holding data/, trash/ and the account store.", "dir", config.root);
+    QCommandLineOption threadsOption(QStringList() << "t" << "threads", "Number of I/O threads, 0 for one per core.", "count", QString::number(config.threads));
+    QCommandLineOption noZeroCopyOption("no-zero-copy", "Always send downloads through the socket buffer instead of sendfile().");
+    parser.addOption(portOption);
+    parser.addOption(rootOption);
+    parser.addOption(threadsOption);
+    QCommandLineOption logFileOption("log-file", "Log file, rotated by size. Defaults to <root>/logs/fileserver.log.", "file", config.logFile);
+    QCommandLineOption logLevelOption("log-level", "Log levels, e.g. \"info\" or \"warning,transfer=debug\". Components: server, network, auth, storage, transfer.", "levels", config.logLevels);
+    QCommandLineOption maxFrameOption("max-frame-size", "Largest request accepted, in bytes. Streamed uploads are not limited by it.", "bytes", QString::number(config.maxFrameSize));
+    parser.addOption(noZeroCopyOption);
+    parser.addOption(logFileOption);
+    parser.addOption(logLevelOption);
+    parser.addOption(maxFrameOption);
+    QCommandLineOption maxFileOption("max-file-size", "Largest file a split upload may announce, in bytes.", "bytes", QString::number(config.maxFileSize));
+    parser.addOption(maxFileOption);
+    QCommandLineOption dedupOption("dedup", "Store uploads as deduplicated blocks under <root>/blocks. Stays on once blocks exist.");
+    parser.addOption(dedupOption);
+    QCommandLineOption noCompressionOption("no-compression", "Never compress responses, even for clients that offer it.");
+    parser.addOption(noCompressionOption);
+
+    if (!parser.parse(arguments)) {
+        error = parser.errorText();
+        return false;
+    }
+
+    if (parser.isSet("help")) {
+        error = parser.helpText();
+        return false;
+    }
+
+    bool ok = false;
+    int port = parser.value(portOption).toInt(&ok);
+    if (!ok || port <= 0 || port > 65535) {
+        error = QString("Invalid port: %1").arg(parser.value(portOption));
+        return false;
+    }
+
+    int threads = parser.value(threadsOption).toInt(&ok);
+    if (!ok || threads < 0) {
+        error = QString("Invalid thread count: %1").arg(parser.value(threadsOption));
+        return false;
+    }
+
+    qint64 maxFrameSize = parser.value(maxFrameOption).toLongLong(&ok);
+    if (!ok || maxFrameSize <= 0) {
+        error = QString("Invalid maximum frame size: %1").arg(parser.value(maxFrameOption));
+        return false;
+    }
+
+    qint64 maxFileSize = parser.value(maxFileOption).toLongLong(&ok);
+    if (!ok || maxFileSize <= 0) {
+        error = QString("Invalid maximum file size: %1").arg(parser.value(maxFileOption));
+        return false;
+    }
+
+    config.port = quint16(port);
+    config.root = parser.value(rootOption);
+    config.threads = threads;
+    config.zeroCopy = !parser.isSet(noZeroCopyOption);
+    config.logFile = parser.value(logFileOption);
+    config.logLevels = parser.value(logLevelOption);
+    config.maxFrameSize = maxFrameSize;
+    config.maxFileSize = maxFileSize;
+    config.dedup = parser.isSet(dedupOption);
+    config.compression = !parser.isSet(noCompressionOption);
+    return true;
+}
@@ -0,0 +1,22 @@
+#ifndef SERVERCONFIG_H
+#define SERVERCONFIG_H
+
+#include <QString>
+#include <QStringList>
+
+struct ServerConfig {
+    quint16 port = 2209;
+    QString root = ".";
+    int threads = 0;
+    bool zeroCopy = true;
+    QString logFile;
+    QString logLevels = "info";
+    qint64 maxFrameSize = 16 * 1024 * 1024;
+    qint64 maxFileSize = Q_INT64_C(64) * 1024 * 1024 * 1024;
+    bool dedup = false;
+    bool compression = true;
+};
+
+bool parseServerConfig(const QStringList& arguments, ServerConfig& config, QString& error);
+
+#endif // !SERVERCONFIG_H
@@ -0,0 +1,1993 @@
+#include "worker.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <QRegularExpression>
+#include <QRandomGenerator>
+#include <QPointer>
+#include <QStorageInfo>
+
+#include <limits>
+#include <cmath>
+#include <cerrno>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <errno.h>
+#endif
+
+#include "server.h"
+#include "logger.h"
+#include "metadatacache.h"
+#include "blockstore.h"
+#include "../FileUtils/utils.h"
+
+static const qint64 CHUNK_SIZE = 64 * 1024;
+static const qint64 ZERO_COPY_CHUNK_SIZE = 16 * CHUNK_SIZE;
+static const qint64 UPLOAD_BUFFER_SIZE = 16 * CHUNK_SIZE;
+// Keeps the reassembly buffer well within what a QByteArray can hold. Larger bodies only come in as streamed uploads.
+static const qint64 MAX_FRAME_LENGTH = std::numeric_limits<int>::max() / 2;
+static const int ADD_FILE_HEADER_SIZE = 256;
+static const int UPLOAD_CHUNK_HEADER_SIZE = 64;
+static const int MAX_PAGE_SIZE = 1000;
+static const int MAX_DOWNLOADS = 8;
+static const int DELTA_MIN_BLOCK_SIZE = 2 * 1024;
+static const int DELTA_MAX_BLOCK_SIZE = 128 * 1024;
+static const int SIGNATURE_HEADER_SIZE = 16;
+static const int DELTA_COMMIT_SIZE = 4 + 8 + 32;
+static const int RANGE_CHUNK_HEADER_SIZE = 64;
+
+// Positioned reads and writes leave the file offset alone, so no seek is needed per chunk.
+static qint64 readAt(QIODevice* device, char* data, qint64 size, qint64 offset) {
+#ifdef Q_OS_UNIX
+    QFile* file = qobject_cast<QFile*>(device);
+    if (file) {
+        ssize_t read;
+        do {
+            read = ::pread(file->handle(), data, size_t(size), off_t(offset));
+        } while (read < 0 && errno == EINTR);
+        return read;
+    }
+#endif
+
+    if (device->pos() != offset && !device->seek(offset)) {
+        return -1;
+    }
+    return device->read(data, size);
+}
+
+static bool writeAt(QFile* file, const char* data, qint64 size, qint64 offset) {
+#ifdef Q_OS_UNIX
+    while (size > 0) {
+        ssize_t written = ::pwrite(file->handle(), data, size_t(size), off_t(offset));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        offset += written;
+        size -= written;
+    }
+    return true;
+#else
+    return file->seek(offset) && file->write(data, size) == size;
+#endif
+}
+
+// The version an upload session's part file holds, see processUploadOpen. Written while the
+// part file is still empty, so its bytes never belong to another version than the one named.
+static bool writeVersion(const QString& partPath, const QByteArray& version) {
+    if (version.isEmpty()) {
+        return !QFileInfo::exists(partPath + ".id") || QFile::remove(partPath + ".id");
+    }
+
+    QSaveFile file(partPath + ".id");
+    return file.open(QIODevice::WriteOnly) && file.write(version) == version.size() && file.commit();
+}
+
+ClientSession::ClientSession(QObject* parent) : QTcpSocket(parent), sockd(-1), attached(false), compression(false), cutShort(false) {
+    input.wakeups = 0;
+    input.frames = 0;
+    input.maxFrames = 0;
+}
+
+Worker::Worker(Server* server, bool zeroCopy) : QObject(), server(server), logger(server->logger()), zeroCopy(zeroCopy), maxFrameSize(qBound<qint64>(1, server->config().maxFrameSize, MAX_FRAME_LENGTH)), nextSessionId(1), currentRequestId(0) {
+
+}
+
+Worker::~Worker() {
+    foreach (ClientSession* client, findChildren<ClientSession*>(QString(), Qt::FindDirectChildrenOnly)) {
+        client->close();
+    }
+
+    foreach (const Output& output, outputs) {
+        foreach (const Download& download, output.downloads) {
+            download.file->close();
+            delete download.file;
+        }
+    }
+
+    foreach (const Upload& upload, uploads) {
+        if (upload.file) {
+            upload.file->remove();
+            delete upload.file;
+        }
+        if (!upload.filePath.isEmpty()) {
+            server->releaseUpload(upload.filePath);
+        }
+    }
+
+    foreach (const UploadSession& session, uploadSessions) {
+        session.file->close();
+        delete session.file;
+        server->releaseUpload(session.filePath);
+    }
+
+    for (QMap<int, DeltaSession>::iterator it = deltaSessions.begin(); it != deltaSessions.end(); ++it) {
+        closeDelta(it.value(), true);
+    }
+
+    foreach (const RangeUpload& range, rangeUploads) {
+        QString tempPath = range.file->fileName();
+        range.file->close();
+        delete range.file;
+        server->closeRange(tempPath);
+    }
+}
+
+void Worker::addConnection(qintptr socketDescriptor) {
+    ClientSession* socket = new ClientSession(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        logger->log(LogError, LogNetwork, socketDescriptor, "addConnection", "Cannot accept:", socket->errorString());
+        delete socket;
+        return;
+    }
+
+    socket->sockd = socket->socketDescriptor();
+
+    connect(socket, &QTcpSocket::readyRead, this, &Worker::onClientReadyRead);
+    connect(socket, &QTcpSocket::disconnected, this, &Worker::onClientDisconnected);
+    connect(socket, &QTcpSocket::bytesWritten, this, &Worker::onClientBytesWritten);
+    connect(socket, &QAbstractSocket::errorOccurred, this, &Worker::onErrorOccurred);
+    logger->log(LogInfo, LogNetwork, socket->socketDescriptor(), "addConnection", "Client has just connected");
+}
+
+void Worker::onClientReadyRead() {
+    ClientSession* socket = static_cast<ClientSession*>(sender());
+
+    // Everything the socket holds is taken in one go and every complete frame in it is
+    // handled before returning. Handlers get views into this buffer, which is only
+    // compacted once per wakeup.
+    Input& input = socket->input;
+    int pos = 0;
+    int frames = 0;
+
+    forever {
+        if (uploads.contains(socket)) {
+            if (!receiveUpload(socket, input.buffer, pos)) {
+                break;
+            }
+            continue;
+        }
+
+        if (input.buffer.size() - pos < FRAME_HEADER_SIZE + ADD_FILE_HEADER_SIZE && socket->bytesAvailable() > 0) {
+            input.buffer.remove(0, pos);
+            pos = 0;
+            input.buffer.append(socket->readAll());
+        }
+
+        if (input.buffer.size() - pos < FRAME_HEADER_SIZE) {
+            break;
+        }
+
+        FrameHeader header;
+        if (!readFrameHeader(input.buffer.constData() + pos, header)) {
+            logger->log(LogWarning, LogNetwork, socket->socketDescriptor(), "onClientReadyRead", "Invalid frame header, closing the connection");
+            socket->disconnectFromHost();
+            return;
+        }
+
+        // An upload is streamed to disk as soon as its header is in, instead of
+        // waiting for the whole message.
+        if (header.type == RequestAddFile && header.length >= quint64(ADD_FILE_HEADER_SIZE)) {
+            if (input.buffer.size() - pos < FRAME_HEADER_SIZE + ADD_FILE_HEADER_SIZE) {
+                break;
+            }
+
+            QByteArray addFileHeader = input.buffer.mid(pos + FRAME_HEADER_SIZE, ADD_FILE_HEADER_SIZE);
+            pos += FRAME_HEADER_SIZE + ADD_FILE_HEADER_SIZE;
+            frames++;
+
+            currentRequestId = header.requestId;
+            processAddFile(socket, addFileHeader, qint64(header.length) - ADD_FILE_HEADER_SIZE);
+            socket->setReadBufferSize(UPLOAD_BUFFER_SIZE);
+            continue;
+        }
+
+        if (header.length > quint64(maxFrameSize)) {
+            logger->log(LogWarning, LogNetwork, socket->socketDescriptor(), "onClientReadyRead", "Frame of %1 bytes is over the %2 byte limit, closing the connection", QStringView(), qint64(header.length), maxFrameSize);
+            socket->disconnectFromHost();
+            return;
+        }
+
+        int frameSize = FRAME_HEADER_SIZE + int(header.length);
+        if (input.buffer.size() - pos < frameSize) {
+            if (socket->bytesAvailable() > 0) {
+                input.buffer.remove(0, pos);
+                pos = 0;
+                input.buffer.append(socket->readAll());
+                continue;
+            }
+
+            logger->log(LogDebug, LogNetwork, socket->socketDescriptor(), "onClientReadyRead", "Waiting for more data to come..");
+            break;
+        }
+
+        handleData(socket, header, QByteArray::fromRawData(input.buffer.constData() + pos + FRAME_HEADER_SIZE, int(header.length)));
+        pos += frameSize;
+        frames++;
+    }
+
+    input.buffer.remove(0, pos);
+
+    input.wakeups++;
+    input.frames += frames;
+    input.maxFrames = qMax(input.maxFrames, frames);
+    logger->log(LogDebug, LogNetwork, socket->socketDescriptor(), "onClientReadyRead", "%1 frames in this wakeup, %2 bytes left buffered", QStringView(), frames, input.buffer.size());
+}
+
+void Worker::onClientDisconnected() {
+    ClientSession* socket = static_cast<ClientSession*>(sender());
+    logger->log(LogInfo, LogNetwork, socket->sockd, "onClientDisconnected", "Client has just disconnected", socket->username);
+    logger->log(LogInfo, LogNetwork, socket->sockd, "onClientDisconnected", "%1 frames in %2 wakeups, at most %3 in one", QStringView(), socket->input.frames, socket->input.wakeups, socket->input.maxFrames);
+    if (!socket->username.isEmpty() && !socket->attached) {
+        server->releaseUser(socket->username, socket);
+    }
+    socket->username = QString();
+
+    // The range file stays for the other connections of the upload, unless it was given up
+    // and this was the last of them, see Server::closeRange().
+    QMutableMapIterator<int, RangeUpload> range(rangeUploads);
+    while (range.hasNext()) {
+        range.next();
+        if (range.value().owner == socket) {
+            QString tempPath = range.value().file->fileName();
+            range.value().file->close();
+            delete range.value().file;
+            server->closeRange(tempPath);
+            range.remove();
+        }
+    }
+
+    QMap<QTcpSocket*, Upload>::iterator upload = uploads.find(socket);
+    if (upload != uploads.end()) {
+        if (upload.value().file) {
+            upload.value().file->remove();
+            delete upload.value().file;
+        }
+        if (!upload.value().filePath.isEmpty()) {
+            server->releaseUpload(upload.value().filePath);
+        }
+        uploads.erase(upload);
+    }
+
+    // Session part files stay on disk so the upload can be resumed after a reconnect.
+    QMutableMapIterator<int, UploadSession> session(uploadSessions);
+    while (session.hasNext()) {
+        session.next();
+        if (session.value().owner == socket) {
+            session.value().file->close();
+            delete session.value().file;
+            server->releaseUpload(session.value().filePath);
+            session.remove();
+        }
+    }
+
+    QMutableMapIterator<int, DeltaSession> delta(deltaSessions);
+    while (delta.hasNext()) {
+        delta.next();
+        if (delta.value().owner == socket) {
+            closeDelta(delta.value(), true);
+            delta.remove();
+        }
+    }
+
+    QMap<QTcpSocket*, Output>::iterator output = outputs.find(socket);
+    if (output != outputs.end()) {
+        foreach (const Download& download, output.value().downloads) {
+            download.file->close();
+            delete download.file;
+        }
+        if (output.value().notifier) {
+            delete output.value().notifier;
+        }
+        outputs.erase(output);
+    }
+
+    socket->deleteLater();
+}
+
+void Worker::onClientBytesWritten(qint64 bytes) {
+    Q_UNUSED(bytes);
+
+    QTcpSocket* socket = reinterpret_cast<QTcpSocket*>(sender());
+    sendNextChunks(socket);
+}
+
+void Worker::onClientWritable() {
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender()->parent());
+    if (socket) {
+        sendNextChunks(socket);
+    }
+}
+
+void Worker::onErrorOccurred(QAbstractSocket::SocketError error) {
+    switch (error) {
+        case QAbstractSocket::RemoteHostClosedError:
+            break;
+
+        default:
+            QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+            logger->log(LogError, LogNetwork, socket->socketDescriptor(), "onErrorOccurred", nullptr, socket->errorString());
+            break;
+    }
+}
+
+void Worker::sendResponse(QTcpSocket* socket, Response type, const QByteArray& data) {
+    if(socket) {
+        // Past a frame cut short the client reads everything as its body, nothing more goes out.
+        if (static_cast<ClientSession*>(socket)->cutShort) {
+            return;
+        }
+
+        if(socket->isOpen()) {
+            QByteArray compressed;
+            bool compress = static_cast<ClientSession*>(socket)->compression && compressPayload(data.constData(), data.size(), compressed);
+            const QByteArray& payload = compress ? compressed : data;
+            QByteArray header = frameHeader(type, payload.size(), currentRequestId, compress ? FRAME_COMPRESSED : 0);
+
+            // While sendfile() owns the descriptor mid-chunk, responses are held back
+            // and flushed once the chunk is complete.
+            QMap<QTcpSocket*, Output>::iterator it = outputs.find(socket);
+            if (it != outputs.end() && it.value().current >= 0) {
+                it.value().deferred.append(header);
+                it.value().deferred.append(payload);
+                return;
+            }
+
+            socket->write(header);
+            socket->write(payload);
+        } else {
+            logger->log(LogError, LogNetwork, -1, "sendResponse", "Socket doesn't seem to be opened");
+        }
+    } else {
+        logger->log(LogError, LogNetwork, -1, "sendResponse", "Not connected");
+    }
+}
+
+void Worker::sendDelta(QTcpSocket* sender, Response type, const QString& path, const QJsonObject& node) {
+    // Only the change goes back: the parent folder and the node added there, or the name removed from it.
+    QString normalized = QDir::fromNativeSeparators(path);
+    int index = normalized.lastIndexOf("/");
+
+    QJsonObject object;
+    object.insert("parent", path.left(qMax(index, 0)));
+    if (node.isEmpty()) {
+        object.insert("op", "remove");
+        object.insert("name", path.mid(index + 1));
+    } else {
+        object.insert("op", "add");
+        object.insert("node", node);
+    }
+
+    QJsonDocument jsonDoc;
+    jsonDoc.setObject(object);
+    QString responseData = jsonDoc.toJson(QJsonDocument::Compact);
+
+    QByteArray byteArray = responseData.toUtf8();
+    sendResponse(sender, type, byteArray);
+}
+
+void Worker::sendFile(QTcpSocket* client, QString filePath, qint64 offset, qint64 length) {
+    if(client) {
+        if(client->isOpen()) {
+            if (outputs.value(client).downloads.size() >= MAX_DOWNLOADS) {
+                QString msg = "Too many downloads in progress";
+                logger->log(LogWarning, LogTransfer, client->socketDescriptor(), "sendFile", nullptr, msg);
+
+                QByteArray byteArray = msg.toUtf8();
+                sendResponse(client, ResponseDownloadError, byteArray);
+                return;
+            }
+
+            // Deduplicated files are put back together from their blocks, which rules out sendfile().
+            QIODevice* file = server->blocks() ? server->blocks()->reader(filePath) : nullptr;
+            bool blocks = file != nullptr;
+            if (!blocks) {
+                file = new QFile(filePath);
+            }
+
+            if(file->open(QIODevice::ReadOnly) && file->seek(offset)){
+                logger->log(LogInfo, LogTransfer, client->socketDescriptor(), "sendFile", "OK! range %1+%2 of", filePath, offset, length);
+
+                QFileInfo fileInfo(filePath);
+                QString fileName(fileInfo.fileName());
+
+                QByteArray header;
+                header.prepend(QString("%1,%2,%3,%4").arg(fileName).arg(file->size()).arg(offset).arg(length).toUtf8());
+                header.resize(128);
+
+                sendResponse(client, ResponseDownloadSuccess, header);
+
+                Download download;
+                download.requestId = currentRequestId;
+                download.file = file;
+                download.start = offset;
+                download.offset = offset;
+                download.end = offset + length;
+                download.compress = false;
+                download.failed = false;
+                download.timer.start();
+
+                // A sample from the start of the range decides, so media keeps going out through sendfile().
+                if (static_cast<ClientSession*>(client)->compression && length > 0) {
+                    QByteArray sample = file->read(qMin<qint64>(length, COMPRESS_SAMPLE_SIZE));
+                    download.compress = worthCompressing(sample.constData(), sample.size());
+                    download.failed = !file->seek(offset);
+                }
+                download.zeroCopy = zeroCopy && !blocks && !download.compress;
+
+                QMap<QTcpSocket*, Output>::iterator it = outputs.find(client);
+                if (it == outputs.end()) {
+                    Output output;
+                    output.next = 0;
+                    output.current = -1;
+                    output.chunkRemaining = 0;
+                    output.notifier = nullptr;
+                    it = outputs.insert(client, output);
+                }
+
+                it.value().downloads.append(download);
+                sendNextChunks(client);
+            } else {
+                delete file;
+
+                QString msg = "Couldn't open the file";
+                logger->log(LogWarning, LogTransfer, client->socketDescriptor(), "sendFile", nullptr, msg);
+
+                QByteArray byteArray = msg.toUtf8();
+                sendResponse(client, ResponseDownloadError, byteArray);
+                return;
+            }
+        } else {
+            logger->log(LogError, LogNetwork, -1, "sendResponse", "Socket doesn't seem to be opened");
+        }
+    } else {
+        logger->log(LogError, LogNetwork, -1, "sendResponse", "Not connected");
+    }
+}
+
+void Worker::sendNextChunks(QTcpSocket* client) {
+    QMap<QTcpSocket*, Output>::iterator it = outputs.find(client);
+    if (it == outputs.end()) {
+        return;
+    }
+
+    Output& output = it.value();
+
+#ifdef Q_OS_LINUX
+    if (output.notifier) {
+        output.notifier->setEnabled(false);
+    }
+
+    // A sendfile() chunk that is partly on the wire has to be finished before anything else goes out.
+    if (output.current >= 0 && !sendChunkZeroCopy(client, output)) {
+        return;
+    }
+#endif
+
+    // Every download gets one chunk in turn, so neither a second download nor a control
+    // response has to wait for a large file to finish.
+    QByteArray chunk;
+    while (!output.downloads.isEmpty() && client->bytesToWrite() < CHUNK_SIZE) {
+        output.next %= output.downloads.size();
+        Download& download = output.downloads[output.next];
+
+        if (download.offset >= download.end || download.failed || static_cast<ClientSession*>(client)->cutShort) {
+            finishDownload(client, output.next);
+            continue;
+        }
+
+#ifdef Q_OS_LINUX
+        if (download.zeroCopy) {
+            // Raw writes may only start once Qt has flushed everything it buffered.
+            if (client->bytesToWrite() > 0) {
+                return;
+            }
+
+            output.current = output.next++;
+            output.chunkRemaining = qMin(ZERO_COPY_CHUNK_SIZE, download.end - download.offset);
+            output.chunkHeader = frameHeader(ResponseDownloadChunk, quint64(output.chunkRemaining), download.requestId);
+            if (!sendChunkZeroCopy(client, output)) {
+                return;
+            }
+            continue;
+        }
+#endif
+
+        // The file is read straight in behind the frame header, one buffer per pass.
+        if (chunk.isEmpty()) {
+            chunk.resize(FRAME_HEADER_SIZE + int(CHUNK_SIZE));
+        }
+
+        qint64 read = readAt(download.file, chunk.data() + FRAME_HEADER_SIZE, qMin(CHUNK_SIZE, download.end - download.offset), download.offset);
+        if (read <= 0) {
+            download.failed = true;
+            continue;
+        }
+
+        // The first chunk that does not shrink turns compression off for the rest of the download.
+        QByteArray compressed;
+        if (download.compress && compressPayload(chunk.constData() + FRAME_HEADER_SIZE, int(read), compressed)) {
+            client->write(frameHeader(ResponseDownloadChunk, quint64(compressed.size()), download.requestId, FRAME_COMPRESSED));
+            client->write(compressed);
+        } else {
+            download.compress = false;
+            writeFrameHeader(chunk.data(), ResponseDownloadChunk, quint64(read), download.requestId);
+            client->write(chunk.constData(), FRAME_HEADER_SIZE + read);
+        }
+        download.offset += read;
+        output.next++;
+    }
+
+    if (output.downloads.isEmpty()) {
+        if (output.notifier) {
+            delete output.notifier;
+        }
+        outputs.erase(it);
+    }
+}
+
+#ifdef Q_OS_LINUX
+bool Worker::sendChunkZeroCopy(QTcpSocket* client, Output& output) {
+    int fd = int(client->socketDescriptor());
+    Download& download = output.downloads[output.current];
+
+    while (!output.chunkHeader.isEmpty() || output.chunkRemaining > 0) {
+        ssize_t sent;
+        if (!output.chunkHeader.isEmpty()) {
+            sent = ::send(fd, output.chunkHeader.constData(), size_t(output.chunkHeader.size()), MSG_NOSIGNAL | MSG_MORE);
+            if (sent > 0) {
+                output.chunkHeader.remove(0, int(sent));
+                continue;
+            }
+        } else {
+            off_t offset = off_t(download.offset);
+            sent = ::sendfile(fd, static_cast<QFile*>(download.file)->handle(), &offset, size_t(output.chunkRemaining));
+            if (sent > 0) {
+                download.offset += sent;
+                output.chunkRemaining -= sent;
+                continue;
+            }
+
+            // Not every file system supports sendfile(), finish the chunk through Qt and stay there.
+            if (sent < 0 && (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+                logger->log(LogWarning, LogTransfer, client->socketDescriptor(), "sendFile", "zero-copy unavailable, falling back");
+
+                download.zeroCopy = false;
+
+                QByteArray rest;
+                if (download.file->seek(download.offset)) {
+                    rest = download.file->read(output.chunkRemaining);
+                }
+
+                if (rest.size() != output.chunkRemaining) {
+                    download.failed = true;
+                    static_cast<ClientSession*>(client)->cutShort = true;
+                } else {
+                    client->write(rest);
+                    download.offset += rest.size();
+                }
+
+                output.chunkRemaining = 0;
+                break;
+            }
+        }
+
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!output.notifier) {
+                output.notifier = new QSocketNotifier(fd, QSocketNotifier::Write, client);
+                connect(output.notifier, QOverload<QSocketDescriptor, QSocketNotifier::Type>::of(&QSocketNotifier::activated), this, &Worker::onClientWritable);
+            }
+            output.notifier->setEnabled(true);
+            return false;
+        }
+
+        // The frame is cut short, the connection is dropped once the download is finished.
+        download.failed = true;
+        static_cast<ClientSession*>(client)->cutShort = true;
+        output.chunkHeader.clear();
+        output.chunkRemaining = 0;
+    }
+
+    output.current = -1;
+    if (static_cast<ClientSession*>(client)->cutShort) {
+        output.deferred.clear();
+    } else if (!output.deferred.isEmpty()) {
+        client->write(output.deferred);
+        output.deferred.clear();
+    }
+
+    return true;
+}
+#endif
+
+void Worker::finishDownload(QTcpSocket* client, int index) {
+    Download download = outputs[client].downloads.takeAt(index);
+
+    qint64 sent = download.offset - download.start;
+    qint64 elapsed = qMax<qint64>(download.timer.elapsed(), 1);
+    logger->log(LogInfo, LogTransfer, client->socketDescriptor(), "sendFile", download.zeroCopy ? "%1 bytes sent in %2 ms, %3 KB/s (sendfile)" : "%1 bytes sent in %2 ms, %3 KB/s (buffered)", QStringView(), sent, elapsed, sent / elapsed);
+
+    if (download.failed) {
+        // The client cannot resynchronise on a short body, drop the connection instead.
+        // Queued, so the socket outlives the caller's loop over its downloads.
+        QMetaObject::invokeMethod(client, [client]() { client->disconnectFromHost(); }, Qt::QueuedConnection);
+    }
+
+    download.file->close();
+    delete download.file;
+}
+
+void Worker::handleData(QTcpSocket* sender, const FrameHeader& header, const QByteArray& payload) {
+    // Every response sent while handling this frame carries its id back.
+    currentRequestId = header.requestId;
+
+    QByteArray data = payload;
+    if ((header.flags & FRAME_COMPRESSED) && !uncompressPayload(payload, maxFrameSize, data)) {
+        QString msg = "Invalid compressed data";
+        logger->log(LogWarning, LogNetwork, sender->socketDescriptor(), "handleData", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseError, byteArray);
+        return;
+    }
+
+    switch (header.type) {
+        case RequestNone:
+            logger->log(LogInfo, LogNetwork, sender->socketDescriptor(), "RequestNone", nullptr, QString::fromUtf8(data));
+            break;
+
+        case RequestSignIn:
+            processSignIn(sender, data);
+            break;
+
+        case RequestSignUp:
+            processSignUp(sender, data);
+            break;
+
+        case RequestSignOut:
+            processSignOut(sender, data);
+            break;
+
+        case RequestGetData:
+            processGetData(sender, data);
+            break;
+
+        case RequestDelete:
+            processDelete(sender, data);
+            break;
+
+        case RequestAddFolder:
+            processAddFolder(sender, data);
+            break;
+
+        case RequestRenameFolder:
+            processRenameFolder(sender, data);
+            break;
+
+        case RequestRenameFile:
+            processRenameFile(sender, data);
+            break;
+
+        case RequestDownload:
+            processDownloadFile(sender, data);
+            break;
+
+        case RequestUploadOpen:
+            processUploadOpen(sender, data);
+            break;
+
+        case RequestUploadChunk:
+            processUploadChunk(sender, data);
+            break;
+
+        case RequestUploadStatus:
+            processUploadStatus(sender, data);
+            break;
+
+        case RequestUploadCancel:
+            processUploadCancel(sender, data);
+            break;
+
+        case RequestHello:
+            processHello(sender, data);
+            break;
+
+        case RequestSignature:
+            processSignature(sender, data);
+            break;
+
+        case RequestDeltaChunk:
+            processDeltaChunk(sender, data);
+            break;
+
+        case RequestDeltaCommit:
+            processDeltaCommit(sender, data);
+            break;
+
+        case RequestAttach:
+            processAttach(sender, data);
+            break;
+
+        case RequestRangeOpen:
+            processRangeOpen(sender, data);
+            break;
+
+        case RequestRangeChunk:
+            processRangeChunk(sender, data);
+            break;
+
+        case RequestRangeCommit:
+            processRangeCommit(sender, data);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void Worker::processHello(QTcpSocket* sender, QByteArray data) {
+    // The client lists the codecs it understands, the reply names the one in use or is empty.
+    ClientSession* client = static_cast<ClientSession*>(sender);
+    client->compression = server->config().compression && QString(data).split(",").contains(COMPRESSION_CODEC);
+
+    logger->log(LogInfo, LogNetwork, sender->socketDescriptor(), "processHello", client->compression ? "compression on" : "compression off");
+
+    QByteArray byteArray = client->compression ? QByteArray(COMPRESSION_CODEC) : QByteArray();
+    sendResponse(sender, ResponseHello, byteArray);
+}
+
+void Worker::processSignIn(QTcpSocket* sender, QByteArray data) {
+    QString dataStr = data;
+    QStringList list = dataStr.split(";");
+    if (list.size() < 2 || list[0].isEmpty() || list[1].isEmpty()) {
+        QString msg = "Invalid data";
+        logger->log(LogWarning, LogAuth, sender->socketDescriptor(), "processSignIn", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseSignInError, byteArray);
+        return;
+    }
+
+    if (!server->accountExists(list[0])) {
+        QString msg = list[0] + " doesn't exist";
+        logger->log(LogWarning, LogAuth, sender->socketDescriptor(), "processSignIn", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseSignInError, byteArray);
+        return;
+    }
+
+    if (QString::compare(list[1], server->accountPassword(list[0])) != 0) {
+        QString msg = list[0] + "The password is incorrect";
+        logger->log(LogWarning, LogAuth, sender->socketDescriptor(), "processSignIn", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseSignInError, byteArray);
+        return;
+    }
+
+    ClientSession* client = static_cast<ClientSession*>(sender);
+    QByteArray token;
+    if (client->attached || client->username == list[0] || !server->claimUser(list[0], client, token)) {
+        QString msg = list[0] + " already signed in";
+        logger->log(LogWarning, LogAuth, sender->socketDescriptor(), "processSignIn", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseSignInError, byteArray);
+        return;
+    }
+
+    if (!client->username.isEmpty()) {
+        server->releaseUser(client->username, client);
+    }
+    client->username = list[0];
+
+    logger->log(LogInfo, LogAuth, sender->socketDescriptor(), "processSignIn", "OK!");
+
+    // The token lets the client open more connections to the same session, see processAttach.
+    QString msg = "SignIn success";
+    QByteArray byteArray = msg.toUtf8() + ";" + token;
+    sendResponse(sender, ResponseSignInSuccess, byteArray);
+}
+
+void Worker::processSignUp(QTcpSocket* sender, QByteArray data) {
+    QString dataStr = data;
+    QStringList list = dataStr.split(";");
+    if (list.size() < 2 || list[0].isEmpty() || list[1].isEmpty()) {
+        QString msg = "Invalid data";
+        logger->log(LogWarning, LogAuth, sender->socketDescriptor(), "processSignUp", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseSignUpError, byteArray);
+        return;
+    }
+
+    if (!server->addAccount(list[0], list[1])) {
+        QString msg = list[0] + " already exist";
+        logger->log(LogWarning, LogAuth, sender->socketDescriptor(), "processSignUp", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseSignUpError, byteArray);
+        return;
+    }
+
+    QDir dir(server->dataPath() + QDir::separator() + list[0]);
+    if (dir.exists()) {
+        dir.removeRecursively();
+    }
+
+    QDir().mkdir(server->dataPath() + QDir::separator() + list[0]);
+
+    logger->log(LogInfo, LogAuth, sender->socketDescriptor(), "processSignUp", "OK!", list[0]);
+
+    QString msg = "SignUp success";
+    QByteArray byteArray = msg.toUtf8();
+    sendResponse(sender, ResponseSignUpSuccess, byteArray);
+}
+
+void Worker::processSignOut(QTcpSocket* sender, QByteArray data) {
+    ClientSession* client = static_cast<ClientSession*>(sender);
+    if (!client->username.isEmpty() && !client->attached) {
+        server->releaseUser(client->username, client);
+    }
+    client->username = QString();
+    client->attached = false;
+
+    logger->log(LogInfo, LogAuth, sender->socketDescriptor(), "processSignOut", "OK!");
+
+    QString msg = "SignOut success";
+    QByteArray byteArray = msg.toUtf8();
+    sendResponse(sender, ResponseSignOutSuccess, byteArray);
+}
+
+void Worker::processGetData(QTcpSocket* sender, QByteArray data) {
+    ClientSession* client = static_cast<ClientSession*>(sender);
+
+    if (client->username.isEmpty()) {
+        QString msg = "Finish signing to continue";
+        logger->log(LogWarning, LogStorage, sender->socketDescriptor(), "processGetData", "client not authenticated");
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseGetDataError, byteArray);
+        return;
+    }
+
+    // A bare username asks for the whole tree, a JSON object for one page of one folder.
+    QJsonDocument jsonDoc = QJsonDocument::fromJson(data);
+    if (jsonDoc.isObject()) {
+        QJsonObject object = jsonDoc.object();
+        QString path = object.value("path").toString(client->username);
+        int depth = qMax(object.value("depth").toInt(1), 1);
+        int limit = qBound(0, object.value("limit").toInt(0), MAX_PAGE_SIZE);
+        if (limit == 0) {
+            limit = MAX_PAGE_SIZE;
+        }
+
+        // Owned by the path as it gets resolved, a ".." never climbs into another user's tree.
+        QString normalized = QDir::cleanPath(QDir::fromNativeSeparators(path));
+        QJsonObject listing;
+        if (!normalized.split("/").contains("..") && (normalized == client->username || normalized.startsWith(client->username + "/"))) {
+            listing = server->metadata()->listing(normalized, depth, object.value("cursor").toString(), limit);
+        }
+
+        if (listing.isEmpty()) {
+            QString msg = "Folder not exists";
+            logger->log(LogWarning, LogStorage, sender->socketDescriptor(), "processGetData", nullptr, msg);
+
+            QByteArray byteArray = msg.toUtf8();
+            sendResponse(sender, ResponseGetDataError, byteArray);
+            return;
+        }
+
+        jsonDoc.setObject(listing);
+    } else {
+        jsonDoc.setObject(server->metadata()->listing(client->username));
+    }
+
+    logger->log(LogInfo, LogStorage, sender->socketDescriptor(), "processGetData", "OK!");
+
+    QString responseData = jsonDoc.toJson(QJsonDocument::Compact);
+
+    QByteArray byteArray = responseData.toUtf8();
+    sendResponse(sender, ResponseGetDataSuccess, byteArray);
+}
+
+void Worker::processDelete(QTcpSocket* sender, QByteArray data) {
+    ClientSession* client = static_cast<ClientSession*>(sender);
+
+    QJsonDocument jsonDoc = QJsonDocument::fromJson(data);
+    if (jsonDoc.isObject() == false) {
+        QString msg = "Invalid data";
+        logger->log(LogWarning, LogStorage, sender->socketDescriptor(), "processDelete", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseDeleteError, byteArray);
+        return;
+    }
+
+    QJsonObject object = jsonDoc.object();
+    QString path = object.value("path").toString();
+    if (!path.startsWith(client->username)) {
+        QString msg = "Invalid data";
+        logger->log(LogWarning, LogStorage, sender->socketDescriptor(), "processDelete", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseDeleteError, byteArray);
+        return;
+    }
+
+    QFileInfo info(server->dataPath() + QDir::separator() + path);
+    if (info.exists()) {
+        if (info.isFile()) {
+            if (!removeFile(info.filePath())) {
+                QString msg = "Cannot delete file";
+                logger->log(LogWarning, LogStorage, sender->socketDescriptor(), "processDelete", nullptr, msg);
+
+                QByteArray byteArray = msg.toUtf8();
+                sendResponse(sender, ResponseDeleteError, byteArray);
+                return;
+            }
+        } else if (info.isDir()) {
+            if (!(server->blocks() ? server->blocks()->remove(info.filePath()) : QDir(info.filePath()).removeRecursively())) {
+                server->metadata()->invalidate(client->username);
+
+                QString msg = "Cannot delete folder";
+                logger->log(LogWarning, LogStorage, sender->socketDescriptor(), "processDelete", nullptr, msg);
+
+                QByteArray byteArray = msg.toUtf8();
+                sendResponse(sender, ResponseDeleteError, byteArray);
+                return;
+            }
+        }
+    }
+
+    logger->log(LogInfo, LogStorage, sender->socketDescriptor(), "processDelete", "Delete success");
+    server->metadata()->removeEntry(path);
+    sendDelta(sender, ResponseDeleteSuccess, path, QJsonObject());
+}
+
+void Worker::processAddFolder(QTcpSocket* sender, QByteArray data) {
+    ClientSession* client = static_cast<ClientSession*>(sender);
+
+    QString str = data;
+    QStringList list = str.split(";");
+    if (list.size() < 2 || list[0].isEmpty() || list[1].isEmpty() || !list[0].startsWith(client->username)) {
+        QString msg = "Invalid data";
+        logger->log(LogWarning, LogStorage, sender->socketDescriptor(), "processAddFolder", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseAddFolderError, byteArray);
+        return;
+    }
+
+    QDir dir(server->dataPath() + QDir::separator() + list[0] + QDir::separator() + list[1]);
+    if (dir.exists()) {
+        QString msg = "Folder already exists";
+        logger->log(LogWarning, LogStorage, sender->socketDescriptor(), "processAddFolder", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseAddFolderError, byteArray);
+        return;
+    }
+
+    if (!QDir().mkdir(server->dataPath() + QDir::separator() + list[0] + QDir::separator() + list[1])) {
+        QString msg = "Cannot create folder";
+        logger->log(LogWarning, LogStorage, sender->socketDescriptor(), "processAddFolder", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseAddFolderError, byteArray);
+        return;
+    }
+
+    logger->log(LogInfo, LogStorage, sender->socketDescriptor(), "processAddFolder", "Create folder success");
+    QFileInfo info(dir.path());
+    QString path = list[0] + QDir::separator() + list[1];
+    sendDelta(sender, ResponseAddFolderSuccess, path, server->metadata()->addEntry(path, true, 0, info.lastModified().toMSecsSinceEpoch()));
+}
+
+void Worker::processRenameFolder(QTcpSocket* sender, QByteArray data) {
+
+}
+
+void Worker::processAddFile(QTcpSocket* sender, QByteArray header, qint64 size) {
+    // The body is drained even when the upload is rejected so the next message stays aligned.
+    Upload upload;
+    upload.requestId = currentRequestId;
+    upload.file = nullptr;
+    upload.remaining = size;
+
+    ClientSession* client = static_cast<ClientSession*>(sender);
+
+    QString headerStr = header;
+    QStringList list = headerStr.split(";");
+    if (list.size() < 2 || list[0].isEmpty() || list[1].isEmpty() || !list[0].startsWith(client->username)) {
+        QString msg = "Invalid data";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processAddFile", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseAddFileError, byteArray);
+        uploads.insert(sender, upload);
+        return;
+    }
+
+    QDir dir(server->dataPath() + QDir::separator() + list[0]);
+    if (!dir.exists()) {
+        QString msg = "Folder not exists";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processAddFile", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseAddFileError, byteArray);
+        uploads.insert(sender, upload);
+        return;
+    }
+
+    QFileInfo info(server->dataPath() + QDir::separator() + list[0] + QDir::separator() + list[1]);
+    if (info.exists() && info.isDir()) {
+        QString msg = "Invalid filename";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processAddFile", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseAddFileError, byteArray);
+        uploads.insert(sender, upload);
+        return;
+    }
+
+    // The part file is shared with upload sessions of the same file, which may be on another worker.
+    if (!server->claimUpload(info.filePath())) {
+        QString msg = "Upload already in progress";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processAddFile", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseAddFileError, byteArray);
+        uploads.insert(sender, upload);
+        return;
+    }
+
+    QFile* file = new QFile(dir.filePath(QString(".") + info.fileName() + ".part"));
+    if (!writeVersion(file->fileName(), QByteArray()) || !file->open(QIODevice::WriteOnly)) {
+        delete file;
+        server->releaseUpload(info.filePath());
+
+        QString msg = "An error occurred while trying to write the file";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processAddFile", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseAddFileError, byteArray);
+        uploads.insert(sender, upload);
+        return;
+    }
+
+    upload.file = file;
+    upload.filePath = info.filePath();
+    uploads.insert(sender, upload);
+}
+
+bool Worker::receiveUpload(QTcpSocket* sender, const QByteArray& buffered, int& pos) {
+    Upload& upload = uploads[sender];
+
+    // The start of the body may already sit in the connection buffer behind its header.
+    qint64 available = qMin(upload.remaining, qint64(buffered.size() - pos));
+    if (available > 0) {
+        writeUpload(upload, buffered.constData() + pos, available);
+        pos += int(available);
+    }
+
+    QByteArray buffer(int(qMin(upload.remaining, CHUNK_SIZE)), Qt::Uninitialized);
+    while (upload.remaining > 0 && sender->bytesAvailable() > 0) {
+        qint64 read = sender->read(buffer.data(), qMin(upload.remaining, qint64(buffer.size())));
+        if (read <= 0) {
+            break;
+        }
+
+        writeUpload(upload, buffer.constData(), read);
+    }
+
+    if (upload.remaining > 0) {
+        return false;
+    }
+
+    finishUpload(sender);
+    return true;
+}
+
+void Worker::writeUpload(Upload& upload, const char* data, qint64 size) {
+    if (upload.file && upload.file->write(data, size) != size) {
+        upload.file->remove();
+        delete upload.file;
+        upload.file = nullptr;
+    }
+
+    upload.remaining -= size;
+}
+
+void Worker::finishUpload(QTcpSocket* sender) {
+    Upload upload = uploads.take(sender);
+    sender->setReadBufferSize(0);
+    currentRequestId = upload.requestId;
+
+    // Rejected uploads have no path and were already answered in processAddFile.
+    if (upload.filePath.isEmpty()) {
+        return;
+    }
+
+    QString tempPath;
+    if (upload.file) {
+        tempPath = upload.file->fileName();
+        upload.file->close();
+        delete upload.file;
+    }
+
+    bool committed = !tempPath.isEmpty() && commitFile(tempPath, upload.filePath);
+    server->releaseUpload(upload.filePath);
+
+    if (!committed) {
+        if (!tempPath.isEmpty()) {
+            removeFile(tempPath);
+        }
+
+        QString msg = "An error occurred while trying to write the file";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processAddFile", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseAddFileError, byteArray);
+        return;
+    }
+
+    logger->log(LogInfo, LogTransfer, sender->socketDescriptor(), "processAddFile", "Add file success");
+    QFileInfo info(upload.filePath);
+    QString path = upload.filePath.mid(server->dataPath().size() + 1);
+    qint64 size = server->blocks() ? server->blocks()->size(upload.filePath) : info.size();
+    sendDelta(sender, ResponseAddFileSuccess, path, server->metadata()->addEntry(path, false, size, info.lastModified().toMSecsSinceEpoch()));
+}
+
+bool Worker::commitFile(const QString& tempPath, const QString& filePath) {
+    // Every commit parks the version it replaces under a name of its own, commits of same-named
+    // files on other workers share the trash folder. Kept until the new file is in, then removed
+    // through removeFile() so its blocks are released.
+    QString trashPath = server->trashPath() + QDir::separator() + QFileInfo(filePath).fileName() + "." + QString::number(QRandomGenerator::global()->generate64(), 16);
+
+    if (server->blocks() && !server->blocks()->store(tempPath)) {
+        return false;
+    }
+
+    bool replaced = QFileInfo::exists(filePath);
+    if (replaced) {
+        if (!QDir().rename(filePath, trashPath)) {
+            return false;
+        }
+    }
+
+    if (!QDir().rename(tempPath, filePath)) {
+        if (replaced) {
+            QDir().rename(trashPath, filePath);
+        }
+        return false;
+    }
+
+    if (replaced) {
+        removeFile(trashPath);
+    }
+
+    return true;
+}
+
+bool Worker::removeFile(const QString& filePath) {
+    if (server->blocks()) {
+        return server->blocks()->remove(filePath);
+    }
+
+    return QFile(filePath).remove();
+}
+
+void Worker::processRenameFile(QTcpSocket* sender, QByteArray data) {
+
+}
+
+void Worker::processDownloadFile(QTcpSocket* sender, QByteArray data) {
+    ClientSession* client = static_cast<ClientSession*>(sender);
+
+    QJsonDocument jsonDoc = QJsonDocument::fromJson(data);
+    if (jsonDoc.isObject() == false) {
+        QString msg = "Invalid data";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processDownloadFile", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseDownloadError, byteArray);
+        return;
+    }
+
+    QJsonObject object = jsonDoc.object();
+    QString path = object.value("path").toString();
+    if (!path.startsWith(client->username)) {
+        QString msg = "Invalid data";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processDownloadFile", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseDownloadError, byteArray);
+        return;
+    }
+
+    QFileInfo info(server->dataPath() + QDir::separator() + path);
+    if (!info.exists() || !info.isFile()) {
+        QString msg = "Invalid data";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processDownloadFile", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseDownloadError, byteArray);
+        return;
+    }
+
+    qint64 size = server->blocks() ? server->blocks()->size(info.filePath()) : info.size();
+    qint64 offset = object.value("offset").toVariant().toLongLong();
+    qint64 length = size - offset;
+    if (object.contains("length")) {
+        length = qMin(object.value("length").toVariant().toLongLong(), length);
+    }
+
+    if (offset < 0 || offset > size || length < 0) {
+        QString msg = "Invalid range";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processDownloadFile", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseDownloadError, byteArray);
+        return;
+    }
+
+    sendFile(sender, info.filePath(), offset, length);
+}
+
+void Worker::processUploadOpen(QTcpSocket* sender, QByteArray data) {
+    ClientSession* client = static_cast<ClientSession*>(sender);
+
+    QString str = data;
+    QStringList list = str.split(";");
+    bool ok = false;
+    qint64 size = list.size() < 3 ? -1 : list[2].toLongLong(&ok);
+    if (list.size() < 3 || list[0].isEmpty() || list[1].isEmpty() || !ok || size < 0 || client->username.isEmpty() || !list[0].startsWith(client->username)) {
+        QString msg = "Invalid data";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processUploadOpen", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseUploadOpenError, byteArray);
+        return;
+    }
+
+    QDir dir(server->dataPath() + QDir::separator() + list[0]);
+    if (!dir.exists()) {
+        QString msg = "Folder not exists";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processUploadOpen", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseUploadOpenError, byteArray);
+        return;
+    }
+
+    QFileInfo info(dir.filePath(list[1]));
+    if (info.exists() && info.isDir()) {
+        QString msg = "Invalid filename";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processUploadOpen", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseUploadOpenError, byteArray);
+        return;
+    }
+
+    if (!server->claimUpload(info.filePath())) {
+        QString msg = "Upload already in progress";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processUploadOpen", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseUploadOpenError, byteArray);
+        return;
+    }
+
+    // The client names the version it sends by size and modification time, kept next to the part
+    // file. What an earlier connection left there is only resumed for that same version.
+    QString partPath = dir.filePath(QString(".") + info.fileName() + ".part");
+    QByteArray version = list.size() >= 4 && !list[3].isEmpty() ? QString("%1;%2").arg(size).arg(list[3]).toUtf8() : QByteArray();
+    QFile versionFile(partPath + ".id");
+    bool resume = !version.isEmpty() && versionFile.open(QIODevice::ReadOnly) && versionFile.readAll() == version;
+    versionFile.close();
+
+    QFile* file = new QFile(partPath);
+    bool opened = file->open(QIODevice::ReadWrite) && ((resume && file->size() <= size) || file->resize(0)) && file->seek(file->size());
+    if (opened && file->size() == 0) {
+        opened = writeVersion(partPath, version);
+    }
+
+    if (!opened) {
+        delete file;
+        server->releaseUpload(info.filePath());
+
+        QString msg = "An error occurred while trying to write the file";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processUploadOpen", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseUploadOpenError, byteArray);
+        return;
+    }
+
+    UploadSession session;
+    session.owner = sender;
+    session.file = file;
+    session.filePath = info.filePath();
+    session.size = size;
+    session.received = file->size();
+    session.nextIndex = 0;
+
+    int id = nextSessionId++;
+    uploadSessions.insert(id, session);
+
+    logger->log(LogInfo, LogTransfer, sender->socketDescriptor(), "processUploadOpen", "session %1, %2 of %3 bytes present for", info.filePath(), id, session.received, size);
+
+    QByteArray byteArray = QString("%1;%2").arg(id).arg(session.received).toUtf8();
+    sendResponse(sender, ResponseUploadOpenSuccess, byteArray);
+
+    if (session.received == size) {
+        commitUploadSession(sender, id);
+    }
+}
+
+void Worker::processUploadChunk(QTcpSocket* sender, QByteArray data) {
+    // Both parts stay views into the received frame, the chunk is written to the file from there.
+    int headerSize = qMin(data.size(), UPLOAD_CHUNK_HEADER_SIZE);
+    QString header = QString::fromUtf8(data.constData(), int(qstrnlen(data.constData(), uint(headerSize))));
+    data = QByteArray::fromRawData(data.constData() + headerSize, data.size() - headerSize);
+
+    QStringList list = header.split(";");
+    int id = list[0].toInt();
+    QMap<int, UploadSession>::iterator it = uploadSessions.find(id);
+    if (list.size() < 3 || it == uploadSessions.end() || it.value().owner != sender) {
+        QString msg = QString("%1;-1;Unknown upload session").arg(id);
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processUploadChunk", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseUploadChunkError, byteArray);
+        return;
+    }
+
+    UploadSession& session = it.value();
+    int index = list[1].toInt();
+    qint64 offset = list[2].toLongLong();
+
+    // Chunks must arrive in order, the reply tells the client where to continue from.
+    if (offset != session.received || session.received + data.size() > session.size) {
+        QString msg = QString("%1;%2;Chunk %3 out of sequence").arg(id).arg(session.received).arg(index);
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processUploadChunk", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseUploadChunkError, byteArray);
+        return;
+    }
+
+    if (session.file->write(data) != data.size()) {
+        QString msg = QString("%1;%2;An error occurred while trying to write the file").arg(id).arg(session.received);
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processUploadChunk", nullptr, msg);
+
+        session.file->resize(session.received);
+        session.file->seek(session.received);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseUploadChunkError, byteArray);
+        return;
+    }
+
+    session.received += data.size();
+    session.nextIndex = index + 1;
+
+    if (session.received == session.size) {
+        commitUploadSession(sender, id);
+    }
+}
+
+void Worker::commitUploadSession(QTcpSocket* sender, int id) {
+    UploadSession finished = uploadSessions.take(id);
+    QString tempPath = finished.file->fileName();
+    finished.file->close();
+    delete finished.file;
+
+    bool committed = commitFile(tempPath, finished.filePath);
+    server->releaseUpload(finished.filePath);
+    if (committed) {
+        QFile::remove(tempPath + ".id");
+    }
+
+    if (!committed) {
+        QString msg = "An error occurred while trying to write the file";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "commitUploadSession", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseAddFileError, byteArray);
+        return;
+    }
+
+    logger->log(LogInfo, LogTransfer, sender->socketDescriptor(), "commitUploadSession", "session %1 committed", QStringView(), id);
+    QFileInfo info(finished.filePath);
+    QString path = finished.filePath.mid(server->dataPath().size() + 1);
+    qint64 size = server->blocks() ? server->blocks()->size(finished.filePath) : info.size();
+    sendDelta(sender, ResponseAddFileSuccess, path, server->metadata()->addEntry(path, false, size, info.lastModified().toMSecsSinceEpoch()));
+}
+
+void Worker::processUploadStatus(QTcpSocket* sender, QByteArray data) {
+    int id = QString(data).toInt();
+    QMap<int, UploadSession>::iterator it = uploadSessions.find(id);
+    qint64 received = -1;
+    if (it != uploadSessions.end() && it.value().owner == sender) {
+        received = it.value().received;
+    }
+
+    logger->log(LogInfo, LogTransfer, sender->socketDescriptor(), "processUploadStatus", "session %1 has %2 bytes", QStringView(), id, received);
+
+    QByteArray byteArray = QString("%1;%2").arg(id).arg(received).toUtf8();
+    sendResponse(sender, ResponseUploadStatus, byteArray);
+}
+
+void Worker::processUploadCancel(QTcpSocket* sender, QByteArray data) {
+    // A split upload is named the way its commit names it, a session by its id.
+    if (data.contains(';')) {
+        processRangeCancel(sender, data);
+        return;
+    }
+
+    int id = QString(data).toInt();
+    QMap<int, UploadSession>::iterator it = uploadSessions.find(id);
+    qint64 received = -1;
+
+    // A delta is not resumed, what was rebuilt of it goes.
+    QMap<int, DeltaSession>::iterator delta = deltaSessions.find(id);
+    if (delta != deltaSessions.end() && delta.value().owner == sender) {
+        closeDelta(delta.value(), true);
+        deltaSessions.erase(delta);
+    }
+
+    // The part file stays, uploading the same file again resumes from it.
+    if (it != uploadSessions.end() && it.value().owner == sender) {
+        received = it.value().received;
+        it.value().file->close();
+        delete it.value().file;
+        server->releaseUpload(it.value().filePath);
+        uploadSessions.erase(it);
+    }
+
+    logger->log(LogInfo, LogTransfer, sender->socketDescriptor(), "processUploadCancel", "session %1 cancelled at %2 bytes", QStringView(), id, received);
+
+    QByteArray byteArray = QString("%1;%2").arg(id).arg(received).toUtf8();
+    sendResponse(sender, ResponseUploadCancel, byteArray);
+}
+
+void Worker::processSignature(QTcpSocket* sender, QByteArray data) {
+    ClientSession* client = static_cast<ClientSession*>(sender);
+
+    QString str = data;
+    QStringList list = str.split(";");
+    if (list.size() < 2 || list[0].isEmpty() || list[1].isEmpty() || client->username.isEmpty() || !list[0].startsWith(client->username)) {
+        QString msg = "Invalid data";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processSignature", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseSignatureError, byteArray);
+        return;
+    }
+
+    // Without a stored version the client falls back to a full upload.
+    QFileInfo info(server->dataPath() + QDir::separator() + list[0] + QDir::separator() + list[1]);
+    if (!info.isFile()) {
+        QString msg = "No stored version";
+        logger->log(LogInfo, LogTransfer, sender->socketDescriptor(), "processSignature", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseSignatureError, byteArray);
+        return;
+    }
+
+    DeltaSession session;
+    session.owner = sender;
+    session.base = server->blocks() ? server->blocks()->reader(info.filePath()) : nullptr;
+    if (!session.base) {
+        session.base = new QFile(info.filePath());
+    }
+    session.file = new QFile(info.dir().filePath(QString(".") + info.fileName() + ".delta.part"));
+    session.filePath = info.filePath();
+    session.hash = new QCryptographicHash(QCryptographicHash::Sha256);
+
+    if (!session.base->open(QIODevice::ReadOnly) || !session.file->open(QIODevice::WriteOnly)) {
+        closeDelta(session, true);
+
+        QString msg = "An error occurred while trying to write the file";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processSignature", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseSignatureError, byteArray);
+        return;
+    }
+
+    // Blocks of about sqrt(size) keep both the signature and the per-block overhead of a
+    // change small: some 22 KiB and 450 KB of signature for a 500 MB file.
+    session.baseSize = session.base->size();
+    session.blockSize = qBound(DELTA_MIN_BLOCK_SIZE, (int(std::sqrt(double(session.baseSize))) + 1023) & ~1023, DELTA_MAX_BLOCK_SIZE);
+    session.blockCount = int((session.baseSize + session.blockSize - 1) / session.blockSize);
+
+    int id = nextSessionId++;
+    quint32 requestId = currentRequestId;
+    QPointer<QTcpSocket> owner(sender);
+
+    // Reading and hashing all of a large stored file takes a while. It is done on the server's
+    // pool and the signature sent from this thread once ready, the other connections here go on.
+    server->signatures()->start([this, session, id, requestId, owner]() {
+        QByteArray signature(SIGNATURE_HEADER_SIZE, Qt::Uninitialized);
+        qToBigEndian<quint32>(quint32(id), signature.data());
+        qToBigEndian<quint32>(quint32(session.blockSize), signature.data() + 4);
+        qToBigEndian<quint64>(quint64(session.baseSize), signature.data() + 8);
+        signature.reserve(SIGNATURE_HEADER_SIZE + session.blockCount * (4 + DELTA_STRONG_SIZE));
+
+        bool ok = true;
+        QByteArray block(session.blockSize, Qt::Uninitialized);
+        for (int i = 0; i < session.blockCount && ok; i++) {
+            qint64 read = session.base->read(block.data(), session.blockSize);
+            if (read <= 0) {
+                ok = false;
+                break;
+            }
+
+            quint32 a, b;
+            char weak[4];
+            weakChecksum(block.constData(), int(read), a, b);
+            qToBigEndian<quint32>(weakDigest(a, b), weak);
+            signature.append(weak, 4);
+            signature.append(strongChecksum(block.constData(), int(read)));
+        }
+
+        QMetaObject::invokeMethod(this, [this, session, id, requestId, owner, signature, ok]() {
+            finishSignature(owner.data(), id, requestId, session, signature, ok);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void Worker::finishSignature(QTcpSocket* sender, int id, quint32 requestId, DeltaSession session, const QByteArray& signature, bool ok) {
+    // The connection went while the signature was being made, so did the upload.
+    if (!sender || sender->state() != QAbstractSocket::ConnectedState) {
+        closeDelta(session, true);
+        return;
+    }
+
+    currentRequestId = requestId;
+
+    if (!ok) {
+        closeDelta(session, true);
+
+        QString msg = "An error occurred while trying to read the file";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processSignature", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseSignatureError, byteArray);
+        return;
+    }
+
+    deltaSessions.insert(id, session);
+
+    logger->log(LogInfo, LogTransfer, sender->socketDescriptor(), "processSignature", "session %1: %2 blocks of %3 bytes", QStringView(), id, session.blockCount, session.blockSize);
+
+    QByteArray byteArray = signature;
+    sendResponse(sender, ResponseSignature, byteArray);
+}
+
+void Worker::processDeltaChunk(QTcpSocket* sender, QByteArray data) {
+    int id = data.size() >= 4 ? int(qFromBigEndian<quint32>(data.constData())) : 0;
+    QMap<int, DeltaSession>::iterator it = deltaSessions.find(id);
+    if (it == deltaSessions.end() || it.value().owner != sender) {
+        QString msg = QString("%1;Unknown delta session").arg(id);
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processDeltaChunk", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseDeltaError, byteArray);
+        return;
+    }
+
+    DeltaSession& session = it.value();
+    QByteArray block;
+    bool ok = true;
+    int pos = 4;
+
+    while (ok && pos < data.size()) {
+        if (data.size() - pos < DELTA_OP_SIZE) {
+            ok = false;
+            break;
+        }
+
+        char op = data.at(pos);
+        quint32 value = qFromBigEndian<quint32>(data.constData() + pos + 1);
+        pos += DELTA_OP_SIZE;
+
+        if (op == DELTA_COPY && value < quint32(session.blockCount)) {
+            qint64 offset = qint64(value) * session.blockSize;
+            qint64 length = qMin<qint64>(session.blockSize, session.baseSize - offset);
+            if (block.isEmpty()) {
+                block.resize(session.blockSize);
+            }
+            ok = session.base->seek(offset) && session.base->read(block.data(), length) == length && writeDelta(session, block.constData(), length);
+        } else if (op == DELTA_LITERAL && value <= quint32(data.size() - pos)) {
+            ok = writeDelta(session, data.constData() + pos, value);
+            pos += int(value);
+        } else {
+            ok = false;
+        }
+    }
+
+    if (!ok) {
+        closeDelta(session, true);
+        deltaSessions.erase(it);
+
+        QString msg = QString("%1;Invalid delta").arg(id);
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processDeltaChunk", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseDeltaError, byteArray);
+    }
+}
+
+void Worker::processDeltaCommit(QTcpSocket* sender, QByteArray data) {
+    int id = data.size() >= DELTA_COMMIT_SIZE ? int(qFromBigEndian<quint32>(data.constData())) : 0;
+    QMap<int, DeltaSession>::iterator it = deltaSessions.find(id);
+    if (it == deltaSessions.end() || it.value().owner != sender) {
+        QString msg = QString("%1;Unknown delta session").arg(id);
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processDeltaCommit", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseDeltaError, byteArray);
+        return;
+    }
+
+    DeltaSession session = it.value();
+    deltaSessions.erase(it);
+
+    // The rebuilt file has to be exactly what the client hashed before it replaces the stored one.
+    qint64 size = qint64(qFromBigEndian<quint64>(data.constData() + 4));
+    bool ok = session.file->size() == size && session.hash->result() == data.mid(12, 32);
+
+    QString tempPath = session.file->fileName();
+    closeDelta(session, false);
+
+    if (!ok || !commitFile(tempPath, session.filePath)) {
+        removeFile(tempPath);
+
+        QString msg = QString("%1;%2").arg(id).arg(ok ? "An error occurred while trying to write the file" : "The rebuilt file does not match");
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processDeltaCommit", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseDeltaError, byteArray);
+        return;
+    }
+
+    logger->log(LogInfo, LogTransfer, sender->socketDescriptor(), "processDeltaCommit", "session %1 committed, %2 bytes", QStringView(), id, size);
+    QFileInfo info(session.filePath);
+    QString path = session.filePath.mid(server->dataPath().size() + 1);
+    qint64 storedSize = server->blocks() ? server->blocks()->size(session.filePath) : info.size();
+    sendDelta(sender, ResponseAddFileSuccess, path, server->metadata()->addEntry(path, false, storedSize, info.lastModified().toMSecsSinceEpoch()));
+}
+
+bool Worker::writeDelta(DeltaSession& session, const char* data, qint64 size) {
+    if (session.file->write(data, size) != size) {
+        return false;
+    }
+
+    session.hash->addData(data, int(size));
+    return true;
+}
+
+void Worker::closeDelta(DeltaSession& session, bool remove) {
+    session.base->close();
+    delete session.base;
+    session.base = nullptr;
+
+    session.file->close();
+    if (remove) {
+        session.file->remove();
+    }
+    delete session.file;
+    session.file = nullptr;
+
+    delete session.hash;
+    session.hash = nullptr;
+}
+
+void Worker::processAttach(QTcpSocket* sender, QByteArray data) {
+    ClientSession* client = static_cast<ClientSession*>(sender);
+
+    // An extra connection of a signed in client, it works on the same account but never owns the sign in.
+    QString username = data.isEmpty() ? QString() : server->tokenUser(data);
+    if (username.isEmpty() || !client->username.isEmpty()) {
+        QString msg = "Invalid session token";
+        logger->log(LogWarning, LogAuth, sender->socketDescriptor(), "processAttach", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseAttachError, byteArray);
+        return;
+    }
+
+    client->username = username;
+    client->attached = true;
+
+    logger->log(LogInfo, LogAuth, sender->socketDescriptor(), "processAttach", "attached to", username);
+
+    QString msg = "Attach success";
+    QByteArray byteArray = msg.toUtf8();
+    sendResponse(sender, ResponseAttachSuccess, byteArray);
+}
+
+void Worker::processRangeOpen(QTcpSocket* sender, QByteArray data) {
+    ClientSession* client = static_cast<ClientSession*>(sender);
+
+    static const QRegularExpression tagPattern("^[0-9a-f]{1,32}$");
+
+    QString str = data;
+    QStringList list = str.split(";");
+    bool ok = list.size() >= 6;
+    qint64 size = ok ? list[2].toLongLong(&ok) : -1;
+    qint64 offset = ok ? list[3].toLongLong(&ok) : -1;
+    qint64 length = ok ? list[4].toLongLong(&ok) : -1;
+    if (!ok || list[0].isEmpty() || list[1].isEmpty() || !tagPattern.match(list[5]).hasMatch() || size < 0 || offset < 0 || length < 0 || offset + length > size
+        || client->username.isEmpty() || !list[0].startsWith(client->username)) {
+        QString msg = "Invalid data";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processRangeOpen", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseRangeError, byteArray);
+        return;
+    }
+
+    QDir dir(server->dataPath() + QDir::separator() + list[0]);
+    QFileInfo info(dir.filePath(list[1]));
+    if (!dir.exists() || (info.exists() && info.isDir())) {
+        QString msg = dir.exists() ? "Invalid filename" : "Folder not exists";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processRangeOpen", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseRangeError, byteArray);
+        return;
+    }
+
+    // The part file is sized up front, so the size the client announces has to fit the limit
+    // and the disk before anything is allocated.
+    QString tempPath = dir.filePath(QString(".") + info.fileName() + "." + list[5] + ".part");
+    qint64 allocated = QFileInfo(tempPath).size();
+    if (size > server->config().maxFileSize || size - allocated > QStorageInfo(dir.absolutePath()).bytesAvailable()) {
+        QString msg = "The file is too large";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processRangeOpen", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseRangeError, byteArray);
+        return;
+    }
+
+    // Counted as open until the range is done or its connection goes. Another upload of the
+    // same file, split or not, is refused meanwhile.
+    if (!server->openRange(tempPath, info.filePath(), client->username)) {
+        QString msg = "Upload already in progress";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processRangeOpen", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseRangeError, byteArray);
+        return;
+    }
+
+    // Every connection of the upload opens the same part file, named after the client's tag, and
+    // writes its own range in place. Sizing it again to the same length leaves written data alone.
+    QFile* file = new QFile(tempPath);
+    if (!file->open(QIODevice::ReadWrite) || (file->size() != size && !file->resize(size))) {
+        delete file;
+        server->closeRange(tempPath);
+
+        QString msg = "An error occurred while trying to write the file";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processRangeOpen", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseRangeError, byteArray);
+        return;
+    }
+
+    // What an earlier connection of the same upload wrote from the offset on is not sent again.
+    RangeUpload range;
+    range.owner = sender;
+    range.file = file;
+    range.offset = offset;
+    range.end = offset + length;
+    range.received = qMin(server->rangeEnd(file->fileName(), offset), range.end) - offset;
+
+    int id = nextSessionId++;
+
+    logger->log(LogInfo, LogTransfer, sender->socketDescriptor(), "processRangeOpen", "range %1, bytes %2 to %3 of", info.filePath(), id, offset + range.received, range.end);
+
+    QByteArray byteArray = QString("%1;%2").arg(id).arg(offset + range.received).toUtf8();
+    sendResponse(sender, ResponseRangeOpen, byteArray);
+
+    if (range.received == length) {
+        QString tempPath = file->fileName();
+        file->close();
+        delete file;
+        server->closeRange(tempPath);
+
+        byteArray = QByteArray::number(id);
+        sendResponse(sender, ResponseRangeDone, byteArray);
+        return;
+    }
+
+    rangeUploads.insert(id, range);
+}
+
+void Worker::processRangeChunk(QTcpSocket* sender, QByteArray data) {
+    int headerSize = qMin(data.size(), RANGE_CHUNK_HEADER_SIZE);
+    QString header = QString::fromUtf8(data.constData(), int(qstrnlen(data.constData(), uint(headerSize))));
+    data = QByteArray::fromRawData(data.constData() + headerSize, data.size() - headerSize);
+
+    QStringList list = header.split(";");
+    int id = list[0].toInt();
+    QMap<int, RangeUpload>::iterator it = rangeUploads.find(id);
+    if (list.size() < 2 || it == rangeUploads.end() || it.value().owner != sender) {
+        QString msg = QString("%1;Unknown range").arg(id);
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processRangeChunk", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseRangeError, byteArray);
+        return;
+    }
+
+    RangeUpload& range = it.value();
+    qint64 offset = list[1].toLongLong();
+    if (offset < range.offset || offset + data.size() > range.end) {
+        QString msg = QString("%1;Chunk outside of the range").arg(id);
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processRangeChunk", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseRangeError, byteArray);
+        return;
+    }
+
+    if (!writeAt(range.file, data.constData(), data.size(), offset)) {
+        QString msg = QString("%1;An error occurred while trying to write the file").arg(id);
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processRangeChunk", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseRangeError, byteArray);
+        return;
+    }
+
+    // Recorded on the server, the commit may come in on another connection and thread.
+    QString tempPath = range.file->fileName();
+    server->addRange(tempPath, offset, offset + data.size());
+    range.received += data.size();
+
+    if (range.received >= range.end - range.offset) {
+        range.file->close();
+        delete range.file;
+        rangeUploads.erase(it);
+        server->closeRange(tempPath);
+
+        logger->log(LogInfo, LogTransfer, sender->socketDescriptor(), "processRangeChunk", "range %1 done", QStringView(), id);
+
+        QByteArray byteArray = QByteArray::number(id);
+        sendResponse(sender, ResponseRangeDone, byteArray);
+    }
+}
+
+void Worker::processRangeCommit(QTcpSocket* sender, QByteArray data) {
+    ClientSession* client = static_cast<ClientSession*>(sender);
+
+    static const QRegularExpression tagPattern("^[0-9a-f]{1,32}$");
+
+    QString str = data;
+    QStringList list = str.split(";");
+    bool ok = list.size() >= 4;
+    qint64 size = ok ? list[2].toLongLong(&ok) : -1;
+    if (!ok || list[0].isEmpty() || list[1].isEmpty() || !tagPattern.match(list[3]).hasMatch() || size < 0
+        || client->username.isEmpty() || !list[0].startsWith(client->username)) {
+        QString msg = "Invalid data";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processRangeCommit", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseAddFileError, byteArray);
+        return;
+    }
+
+    QDir dir(server->dataPath() + QDir::separator() + list[0]);
+    QString filePath = dir.filePath(list[1]);
+    QString tempPath = dir.filePath(QString(".") + QFileInfo(filePath).fileName() + "." + list[3] + ".part");
+
+    // Refused while a connection still has a range of it open, the part file stays for it.
+    // Written is -1 where no range of it was opened, then the claim on the file is not ours.
+    qint64 written = 0;
+    if (!server->takeRanges(tempPath, written)) {
+        QString msg = "The upload is still in progress";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processRangeCommit", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseAddFileError, byteArray);
+        return;
+    }
+
+    // Only a part file every byte of which some connection has written gets committed.
+    bool complete = written == size && QFileInfo(tempPath).size() == size;
+    bool committed = complete && commitFile(tempPath, filePath);
+    if (written >= 0) {
+        server->releaseUpload(filePath);
+    }
+
+    if (!committed) {
+        removeFile(tempPath);
+
+        QString msg = complete ? "An error occurred while trying to write the file" : "The upload is incomplete";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processRangeCommit", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseAddFileError, byteArray);
+        return;
+    }
+
+    logger->log(LogInfo, LogTransfer, sender->socketDescriptor(), "processRangeCommit", "%1 bytes committed to", filePath, size);
+    QFileInfo info(filePath);
+    QString path = filePath.mid(server->dataPath().size() + 1);
+    qint64 storedSize = server->blocks() ? server->blocks()->size(filePath) : info.size();
+    sendDelta(sender, ResponseAddFileSuccess, path, server->metadata()->addEntry(path, false, storedSize, info.lastModified().toMSecsSinceEpoch()));
+}
+
+void Worker::processRangeCancel(QTcpSocket* sender, QByteArray data) {
+    ClientSession* client = static_cast<ClientSession*>(sender);
+
+    static const QRegularExpression tagPattern("^[0-9a-f]{1,32}$");
+
+    QStringList list = QString(data).split(";");
+    if (list.size() < 4 || list[0].isEmpty() || list[1].isEmpty() || !tagPattern.match(list[3]).hasMatch()
+        || client->username.isEmpty() || !list[0].startsWith(client->username)) {
+        QString msg = "Invalid data";
+        logger->log(LogWarning, LogTransfer, sender->socketDescriptor(), "processRangeCancel", nullptr, msg);
+
+        QByteArray byteArray = msg.toUtf8();
+        sendResponse(sender, ResponseRangeError, byteArray);
+        return;
+    }
+
+    // Connections still writing into the part file keep it until the last of them is gone.
+    QDir dir(server->dataPath() + QDir::separator() + list[0]);
+    QString tempPath = dir.filePath(QString(".") + QFileInfo(list[1]).fileName() + "." + list[3] + ".part");
+    server->cancelRanges(tempPath);
+
+    logger->log(LogInfo, LogTransfer, sender->socketDescriptor(), "processRangeCancel", "upload cancelled", tempPath);
+
+    QByteArray byteArray = data;
+    sendResponse(sender, ResponseUploadCancel, byteArray);
+}
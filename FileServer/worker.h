@@ -0,0 +1,184 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <QObject>
+#include <QMap>
+#include <QList>
+#include <QTcpSocket>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QFile>
+#include <QSocketNotifier>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+
+#include "../FileUtils/utils.h"
+
+class Server;
+class Logger;
+
+struct Download {
+    quint32 requestId;
+    QIODevice* file;
+    qint64 start;
+    qint64 offset;
+    qint64 end;
+    bool zeroCopy;
+    bool compress;
+    bool failed;
+    QElapsedTimer timer;
+};
+
+// Downloads of one connection, served a chunk each in turn, and the sendfile() chunk
+// currently on the wire. Responses are deferred while such a chunk is incomplete.
+struct Output {
+    QList<Download> downloads;
+    int next;
+    int current;
+    QByteArray chunkHeader;
+    qint64 chunkRemaining;
+    QByteArray deferred;
+    QSocketNotifier* notifier;
+};
+
+// Reassembly buffer of one connection and how many frames each wakeup found in it.
+struct Input {
+    QByteArray buffer;
+    qint64 wakeups;
+    qint64 frames;
+    int maxFrames;
+};
+
+// A client connection and what is known about it, reached from the socket itself so
+// handlers need no lookup. It lives until onClientDisconnected() deletes the socket.
+class ClientSession : public QTcpSocket {
+    Q_OBJECT
+
+public:
+    ClientSession(QObject* parent = nullptr);
+
+    qint64 sockd;
+    QString username;
+    bool attached;
+    bool compression;
+    bool cutShort;
+    Input input;
+};
+
+struct Upload {
+    quint32 requestId;
+    QFile* file;
+    QString filePath;
+    qint64 remaining;
+};
+
+struct UploadSession {
+    QTcpSocket* owner;
+    QFile* file;
+    QString filePath;
+    qint64 size;
+    qint64 received;
+    int nextIndex;
+};
+
+// A re-upload rebuilt from the stored file plus the client's literal data. The stored
+// file stays open, so ops refer to the version the signature was made from.
+struct DeltaSession {
+    QTcpSocket* owner;
+    QIODevice* base;
+    QFile* file;
+    QString filePath;
+    qint64 baseSize;
+    int blockSize;
+    int blockCount;
+    QCryptographicHash* hash;
+};
+
+// One connection's share of a file uploaded over several, written in place into a
+// temporary file common to all of them.
+struct RangeUpload {
+    QTcpSocket* owner;
+    QFile* file;
+    qint64 offset;
+    qint64 end;
+    qint64 received;
+};
+
+class Worker : public QObject {
+    Q_OBJECT
+
+public:
+    Worker(Server* server, bool zeroCopy);
+    ~Worker();
+
+public slots:
+    void addConnection(qintptr socketDescriptor);
+
+private slots:
+    void onClientReadyRead();
+    void onClientDisconnected();
+    void onClientBytesWritten(qint64 bytes);
+    void onClientWritable();
+    void onErrorOccurred(QAbstractSocket::SocketError error);
+
+    void sendResponse(QTcpSocket* socket, Response type, const QByteArray& data);
+    void sendDelta(QTcpSocket* sender, Response type, const QString& path, const QJsonObject& node);
+    void sendFile(QTcpSocket* client, QString filePath, qint64 offset, qint64 length);
+    void sendNextChunks(QTcpSocket* client);
+    void finishDownload(QTcpSocket* client, int index);
+
+    void handleData(QTcpSocket* sender, const FrameHeader& header, const QByteArray& payload);
+    void processHello(QTcpSocket* sender, QByteArray data);
+    void processSignIn(QTcpSocket* sender, QByteArray data);
+    void processSignUp(QTcpSocket* sender, QByteArray data);
+    void processSignOut(QTcpSocket* sender, QByteArray data);
+    void processGetData(QTcpSocket* sender, QByteArray data);
+    void processDelete(QTcpSocket* sender, QByteArray data);
+    void processAddFolder(QTcpSocket* sender, QByteArray data);
+    void processRenameFolder(QTcpSocket* sender, QByteArray data);
+    void processAddFile(QTcpSocket* sender, QByteArray header, qint64 size);
+    bool receiveUpload(QTcpSocket* sender, const QByteArray& buffered, int& pos);
+    void finishUpload(QTcpSocket* sender);
+    bool commitFile(const QString& tempPath, const QString& filePath);
+    bool removeFile(const QString& filePath);
+    void processRenameFile(QTcpSocket* sender, QByteArray data);
+    void processDownloadFile(QTcpSocket* sender, QByteArray data);
+    void processUploadOpen(QTcpSocket* sender, QByteArray data);
+    void processUploadChunk(QTcpSocket* sender, QByteArray data);
+    void processUploadStatus(QTcpSocket* sender, QByteArray data);
+    void processUploadCancel(QTcpSocket* sender, QByteArray data);
+    void commitUploadSession(QTcpSocket* sender, int id);
+    void processSignature(QTcpSocket* sender, QByteArray data);
+    void processDeltaChunk(QTcpSocket* sender, QByteArray data);
+    void processDeltaCommit(QTcpSocket* sender, QByteArray data);
+    void processAttach(QTcpSocket* sender, QByteArray data);
+    void processRangeOpen(QTcpSocket* sender, QByteArray data);
+    void processRangeChunk(QTcpSocket* sender, QByteArray data);
+    void processRangeCommit(QTcpSocket* sender, QByteArray data);
+    void processRangeCancel(QTcpSocket* sender, QByteArray data);
+
+private:
+    void writeUpload(Upload& upload, const char* data, qint64 size);
+    bool writeDelta(DeltaSession& session, const char* data, qint64 size);
+    void closeDelta(DeltaSession& session, bool remove);
+    void finishSignature(QTcpSocket* sender, int id, quint32 requestId, DeltaSession session, const QByteArray& signature, bool ok);
+
+#ifdef Q_OS_LINUX
+    bool sendChunkZeroCopy(QTcpSocket* client, Output& output);
+#endif
+
+    Server* server;
+    Logger* logger;
+    bool zeroCopy;
+    qint64 maxFrameSize;
+    QMap<QTcpSocket*, Output> outputs;
+    QMap<QTcpSocket*, Upload> uploads;
+    QMap<int, UploadSession> uploadSessions;
+    QMap<int, DeltaSession> deltaSessions;
+    QMap<int, RangeUpload> rangeUploads;
+    int nextSessionId;
+    quint32 currentRequestId;
+};
+
+#endif // !WORKER_H
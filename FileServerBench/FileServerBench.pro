@@ -0,0 +1,11 @@
+QT       += core network
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+SOURCES += \
+    main.cpp
+
+HEADERS += \
+    ../FileUtils/utils.h
@@ -0,0 +1,377 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+#include <QTemporaryDir>
+#include <QProcess>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QStandardPaths>
+#include <QFile>
+#include <QDir>
+#include <QThread>
+#include <QSemaphore>
+#include <QAtomicInteger>
+#include <QDebug>
+
+#include <unistd.h>
+
+#include "../FileUtils/utils.h"
+
+// Serves one file over loopback from a FileServerDaemon started with and without
+// --no-zero-copy, and reports throughput and the server's CPU time per GB for both.
+// With --load, several clients download at once instead, against a server run with
+// each of the given I/O thread counts in turn, to show how throughput scales with them.
+
+static const qint64 MIB = 1024 * 1024;
+static const int READ_SIZE = 1024 * 1024;
+static const int TIMEOUT = 30 * 1000;
+static const char* const PASSWORD = "bench";
+
+struct Result {
+    qint64 bytes;
+    qint64 elapsed;
+    double cpu;
+};
+
+// User plus system time of a process in seconds, -1 where /proc is not there.
+static double cpuSeconds(qint64 pid) {
+    QFile file(QString("/proc/%1/stat").arg(pid));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+
+    // The command name may hold spaces, fields are counted from behind its closing parenthesis.
+    QByteArray stat = file.readAll();
+    QList<QByteArray> fields = stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+    if (fields.size() < 13) {
+        return -1;
+    }
+
+    return double(fields[11].toLongLong() + fields[12].toLongLong()) / double(sysconf(_SC_CLK_TCK));
+}
+
+static bool readExactly(QTcpSocket& socket, char* data, qint64 size) {
+    while (size > 0) {
+        if (socket.bytesAvailable() == 0 && !socket.waitForReadyRead(TIMEOUT)) {
+            return false;
+        }
+
+        qint64 read = socket.read(data, size);
+        if (read < 0) {
+            return false;
+        }
+        data += read;
+        size -= read;
+    }
+
+    return true;
+}
+
+static bool readFrame(QTcpSocket& socket, FrameHeader& header, QByteArray& payload) {
+    char buffer[FRAME_HEADER_SIZE];
+    if (!readExactly(socket, buffer, FRAME_HEADER_SIZE) || !readFrameHeader(buffer, header) || header.length > quint64(READ_SIZE)) {
+        return false;
+    }
+
+    payload.resize(int(header.length));
+    return readExactly(socket, payload.data(), payload.size());
+}
+
+static void writeFrame(QTcpSocket& socket, Request type, quint32 requestId, const QByteArray& data) {
+    socket.write(frameHeader(type, data.size(), requestId));
+    socket.write(data);
+}
+
+// A user per client, a session is only ever signed in once.
+static QByteArray username(int client) {
+    return "bench" + QByteArray::number(client);
+}
+
+static bool prepareRoot(const QString& root, qint64 size, int clients) {
+    // The account journal and the files are put in place before the server starts.
+    QFile journal(QDir(root).filePath("accounts.journal"));
+    if (!journal.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    for (int i = 0; i < clients; i++) {
+        if (journal.write("+ " + username(i) + " " + PASSWORD + "\n") <= 0) {
+            return false;
+        }
+    }
+    journal.close();
+
+    QString folder = QDir(root).filePath("data/" + QString(username(0)));
+    if (!QDir().mkpath(folder)) {
+        return false;
+    }
+
+    QString filePath = QDir(folder).filePath("bench.bin");
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    // Random bytes, so neither compression nor the file system can shortcut the reads.
+    QByteArray block(READ_SIZE, Qt::Uninitialized);
+    for (qint64 written = 0; written < size; written += block.size()) {
+        QRandomGenerator::global()->fillRange(reinterpret_cast<quint32*>(block.data()), block.size() / int(sizeof(quint32)));
+        if (file.write(block.constData(), qMin<qint64>(block.size(), size - written)) <= 0) {
+            return false;
+        }
+    }
+    file.close();
+
+    // The other users get the same file under a hard link, so every client reads from one copy in the page cache.
+    for (int i = 1; i < clients; i++) {
+        QString other = QDir(root).filePath("data/" + QString(username(i)));
+        if (!QDir().mkpath(other) || ::link(QFile::encodeName(filePath).constData(), QFile::encodeName(QDir(other).filePath("bench.bin")).constData()) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool download(QTcpSocket& socket, int client, quint32 requestId, qint64 size) {
+    QByteArray path = "{\"path\":\"" + username(client) + "/bench.bin\"}";
+    writeFrame(socket, RequestDownload, requestId, path);
+
+    FrameHeader header;
+    QByteArray payload;
+    if (!readFrame(socket, header, payload) || header.type != ResponseDownloadSuccess) {
+        return false;
+    }
+
+    qint64 received = 0;
+    while (received < size) {
+        if (!readFrame(socket, header, payload) || header.type != ResponseDownloadChunk || header.requestId != requestId) {
+            return false;
+        }
+        received += payload.size();
+    }
+
+    return received == size;
+}
+
+static bool startServer(QProcess& server, const QString& serverPath, const QString& root, quint16 port, int threads, bool zeroCopy) {
+    QStringList arguments;
+    arguments << "--root" << root << "--port" << QString::number(port) << "--threads" << QString::number(threads) << "--log-level" << "warning" << "--no-compression";
+    if (!zeroCopy) {
+        arguments << "--no-zero-copy";
+    }
+
+    server.setProcessChannelMode(QProcess::ForwardedChannels);
+    server.start(serverPath, arguments);
+    if (!server.waitForStarted()) {
+        qCritical().noquote() << QString("Cannot start %1: %2").arg(serverPath, server.errorString());
+        return false;
+    }
+
+    return true;
+}
+
+static void stopServer(QProcess& server) {
+    server.terminate();
+    if (!server.waitForFinished()) {
+        server.kill();
+        server.waitForFinished();
+    }
+}
+
+static bool signIn(QTcpSocket& socket, quint16 port, int client) {
+    QElapsedTimer wait;
+    wait.start();
+    do {
+        QThread::msleep(50);
+        socket.connectToHost(QHostAddress::LocalHost, port);
+    } while (!socket.waitForConnected(1000) && wait.elapsed() < TIMEOUT);
+
+    if (socket.state() != QAbstractSocket::ConnectedState) {
+        return false;
+    }
+
+    FrameHeader header;
+    QByteArray payload;
+    writeFrame(socket, RequestSignIn, 1, username(client) + ";" + PASSWORD);
+    return readFrame(socket, header, payload) && header.type == ResponseSignInSuccess;
+}
+
+static bool runMode(const QString& serverPath, const QString& root, quint16 port, int threads, bool zeroCopy, qint64 size, int runs, QList<Result>& results) {
+    QProcess server;
+    if (!startServer(server, serverPath, root, port, threads, zeroCopy)) {
+        return false;
+    }
+
+    QTcpSocket socket;
+    bool ok = signIn(socket, port, 0);
+
+    // The first download only warms the page cache and is not counted.
+    quint32 requestId = 2;
+    ok = ok && download(socket, 0, requestId++, size);
+    for (int i = 0; ok && i < runs; i++) {
+        double cpu = cpuSeconds(server.processId());
+        QElapsedTimer timer;
+        timer.start();
+
+        ok = download(socket, 0, requestId++, size);
+
+        Result result;
+        result.bytes = size;
+        result.elapsed = qMax<qint64>(timer.elapsed(), 1);
+        result.cpu = cpu < 0 ? -1 : cpuSeconds(server.processId()) - cpu;
+        results.append(result);
+    }
+
+    if (!ok) {
+        qCritical().noquote() << QString("Download failed: %1").arg(socket.errorString());
+    }
+
+    socket.close();
+    stopServer(server);
+    return ok;
+}
+
+// Every client signs in and warms up on its own connection and thread, then all of them
+// download at once. Timed from the common start until the last one is done.
+static bool runLoad(const QString& serverPath, const QString& root, quint16 port, int threads, int clients, qint64 size, int runs, Result& result) {
+    QProcess server;
+    if (!startServer(server, serverPath, root, port, threads, true)) {
+        return false;
+    }
+
+    QSemaphore ready;
+    QSemaphore go;
+    QAtomicInteger<int> failed(0);
+    QList<QThread*> workers;
+    for (int i = 0; i < clients; i++) {
+        workers.append(QThread::create([&, i]() {
+            QTcpSocket socket;
+            quint32 requestId = 2;
+            bool ok = signIn(socket, port, i) && download(socket, i, requestId++, size);
+            ready.release();
+
+            go.acquire();
+            for (int run = 0; ok && run < runs; run++) {
+                ok = download(socket, i, requestId++, size);
+            }
+
+            if (!ok) {
+                qCritical().noquote() << QString("Client %1 failed: %2").arg(i).arg(socket.errorString());
+                failed.fetchAndAddRelaxed(1);
+            }
+            socket.close();
+        }));
+        workers.last()->start();
+    }
+
+    ready.acquire(clients);
+    double cpu = cpuSeconds(server.processId());
+    QElapsedTimer timer;
+    timer.start();
+    go.release(clients);
+
+    foreach (QThread* worker, workers) {
+        worker->wait();
+        delete worker;
+    }
+
+    result.bytes = size * clients * runs;
+    result.elapsed = qMax<qint64>(timer.elapsed(), 1);
+    result.cpu = cpu < 0 ? -1 : cpuSeconds(server.processId()) - cpu;
+
+    stopServer(server);
+    return failed.loadRelaxed() == 0;
+}
+
+static QString describe(const Result& result) {
+    double seconds = double(result.elapsed) / 1000;
+    double gigabytes = double(result.bytes) / (1024 * MIB);
+    QString cpu = result.cpu < 0 ? QString("n/a") : QString::number(result.cpu / gigabytes, 'f', 3);
+    return QString("%1 MiB in %2 s, %3 MB/s, %4 CPU s per GB").arg(result.bytes / MIB).arg(seconds, 0, 'f', 3).arg(double(result.bytes) / MIB / seconds, 0, 'f', 1).arg(cpu);
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Compares sendfile() and buffered downloads of FileServerDaemon over loopback");
+    parser.addHelpOption();
+
+    QString defaultServer = QStandardPaths::findExecutable("FileServerDaemon", QStringList() << a.applicationDirPath());
+    QCommandLineOption serverOption("server", "FileServerDaemon binary to run.", "path", defaultServer.isEmpty() ? QString("FileServerDaemon") : defaultServer);
+    QCommandLineOption sizeOption("size", "Size of the served file in MiB.", "mib", "1024");
+    QCommandLineOption runsOption("runs", "Timed downloads per mode, after one warm-up.", "count", "3");
+    QCommandLineOption portOption("port", "Loopback port for the server.", "port", "22090");
+    QCommandLineOption threadsOption("threads", "I/O threads of the server.", "count", "1");
+    QCommandLineOption loadOption("load", "Run the multi-client load test instead of the sendfile comparison.");
+    QCommandLineOption clientsOption("clients", "Concurrent clients of the load test.", "count", "16");
+    QCommandLineOption threadCountsOption("thread-counts", "I/O thread counts the load test runs the server with.", "list", "1,2,4,8");
+    parser.addOption(serverOption);
+    parser.addOption(sizeOption);
+    parser.addOption(runsOption);
+    parser.addOption(portOption);
+    parser.addOption(threadsOption);
+    parser.addOption(loadOption);
+    parser.addOption(clientsOption);
+    parser.addOption(threadCountsOption);
+    parser.process(a);
+
+    qint64 size = parser.value(sizeOption).toLongLong() * MIB;
+    int runs = parser.value(runsOption).toInt();
+    quint16 port = quint16(parser.value(portOption).toUInt());
+    int threads = parser.value(threadsOption).toInt();
+    bool load = parser.isSet(loadOption);
+    int clients = load ? parser.value(clientsOption).toInt() : 1;
+    QList<int> threadCounts;
+    foreach (const QString& count, parser.value(threadCountsOption).split(",", Qt::SkipEmptyParts)) {
+        threadCounts.append(count.toInt());
+        if (threadCounts.last() < 0) {
+            threadCounts.clear();
+            break;
+        }
+    }
+    if (size <= 0 || runs <= 0 || port == 0 || threads < 0 || clients <= 0 || threadCounts.isEmpty()) {
+        qCritical().noquote() << parser.helpText();
+        return EXIT_FAILURE;
+    }
+
+    QTemporaryDir root;
+    if (!root.isValid() || !prepareRoot(root.path(), size, clients)) {
+        qCritical().noquote() << "Cannot prepare the server root";
+        return EXIT_FAILURE;
+    }
+
+    if (load) {
+        qInfo().noquote() << QString("%1 clients, %2 cores").arg(clients).arg(QThread::idealThreadCount());
+        foreach (int count, threadCounts) {
+            Result result;
+            if (!runLoad(parser.value(serverOption), root.path(), port, count, clients, size, runs, result)) {
+                return EXIT_FAILURE;
+            }
+            qInfo().noquote() << QString("%1 I/O threads: %2").arg(count).arg(describe(result));
+        }
+        return EXIT_SUCCESS;
+    }
+
+    const bool modes[] = { true, false };
+    for (bool zeroCopy : modes) {
+        QString name = zeroCopy ? "sendfile" : "buffered";
+        QList<Result> results;
+        if (!runMode(parser.value(serverOption), root.path(), port, threads, zeroCopy, size, runs, results)) {
+            return EXIT_FAILURE;
+        }
+
+        Result best = results.first();
+        foreach (const Result& result, results) {
+            qInfo().noquote() << QString("%1: %2").arg(name, describe(result));
+            if (result.elapsed < best.elapsed) {
+                best = result;
+            }
+        }
+        qInfo().noquote() << QString("%1 best: %2").arg(name, describe(best));
+    }
+
+    return EXIT_SUCCESS;
+}
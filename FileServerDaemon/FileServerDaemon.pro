@@ -0,0 +1,32 @@
+QT       += core network
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../FileServer
+
+SOURCES += \
+    main.cpp \
+    ../FileServer/accountstore.cpp \
+    ../FileServer/blockstore.cpp \
+    ../FileServer/logger.cpp \
+    ../FileServer/metadatacache.cpp \
+    ../FileServer/server.cpp \
+    ../FileServer/serverconfig.cpp \
+    ../FileServer/worker.cpp
+
+HEADERS += \
+    ../FileServer/accountstore.h \
+    ../FileServer/blockstore.h \
+    ../FileServer/logger.h \
+    ../FileServer/metadatacache.h \
+    ../FileServer/server.h \
+    ../FileServer/serverconfig.h \
+    ../FileServer/worker.h \
+    ../FileUtils/utils.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,26 @@
+#include <QCoreApplication>
+#include <QDebug>
+
+#include "server.h"
+#include "serverconfig.h"
+
+int main(int argc, char* argv[]) {
+    QCoreApplication a(argc, argv);
+
+    ServerConfig config;
+    QString error;
+    if (!parseServerConfig(a.arguments(), config, error)) {
+        qInfo().noquote() << error;
+        return EXIT_FAILURE;
+    }
+
+    Server server(config);
+    if (!server.start()) {
+        qCritical().noquote() << QString("Unable to start the server: %1.").arg(server.errorString());
+        return EXIT_FAILURE;
+    }
+
+    qInfo().noquote() << QString("Listening on port %1").arg(server.serverPort());
+
+    return a.exec();
+}
@@ -1,6 +1,10 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QtEndian>
+
 enum Request {
     RequestNone,
     RequestSignIn,
@@ -13,6 +17,18 @@ enum Request {
     RequestAddFile,
     RequestRenameFile,
     RequestDownload,
+    RequestUploadOpen,
+    RequestUploadChunk,
+    RequestUploadStatus,
+    RequestHello,
+    RequestSignature,
+    RequestDeltaChunk,
+    RequestDeltaCommit,
+    RequestAttach,
+    RequestRangeOpen,
+    RequestRangeChunk,
+    RequestRangeCommit,
+    RequestUploadCancel,
 };
 
 enum Response {
@@ -39,6 +55,130 @@ enum Response {
     ResponseDownloadError,
     ResponseSuccess,
     ResponseError,
+    ResponseDownloadChunk,
+    ResponseUploadOpenSuccess,
+    ResponseUploadOpenError,
+    ResponseUploadStatus,
+    ResponseUploadChunkError,
+    ResponseHello,
+    ResponseSignature,
+    ResponseSignatureError,
+    ResponseDeltaError,
+    ResponseAttachSuccess,
+    ResponseAttachError,
+    ResponseRangeOpen,
+    ResponseRangeError,
+    ResponseRangeDone,
+    ResponseUploadCancel,
+};
+
+// Every message is a fixed binary header followed by `length` payload bytes. All fields are
+// big-endian: magic(4) version(1) flags(1) type(2) requestId(4) length(8).
+static const quint32 FRAME_MAGIC = 0x46535031; // "FSP1"
+static const quint8 FRAME_VERSION = 1;
+static const int FRAME_HEADER_SIZE = 20;
+
+// Set on frames whose payload is qCompress() output. Only sent once the peer has listed the
+// codec in its RequestHello, but always understood.
+static const quint8 FRAME_COMPRESSED = 0x01;
+static const char* const COMPRESSION_CODEC = "deflate";
+static const int COMPRESS_MIN_SIZE = 256;
+static const int COMPRESS_SAMPLE_SIZE = 4096;
+
+struct FrameHeader {
+    quint8 version;
+    quint8 flags;
+    quint16 type;
+    quint32 requestId;
+    quint64 length;
 };
 
+inline void writeFrameHeader(char* out, quint16 type, quint64 length, quint32 requestId = 0, quint8 flags = 0) {
+    qToBigEndian<quint32>(FRAME_MAGIC, out);
+    out[4] = char(FRAME_VERSION);
+    out[5] = char(flags);
+    qToBigEndian<quint16>(type, out + 6);
+    qToBigEndian<quint32>(requestId, out + 8);
+    qToBigEndian<quint64>(length, out + 12);
+}
+
+inline QByteArray frameHeader(quint16 type, quint64 length, quint32 requestId = 0, quint8 flags = 0) {
+    QByteArray header(FRAME_HEADER_SIZE, Qt::Uninitialized);
+    writeFrameHeader(header.data(), type, length, requestId, flags);
+    return header;
+}
+
+// False when the bytes are not a frame this build understands.
+inline bool readFrameHeader(const char* data, FrameHeader& header) {
+    if (qFromBigEndian<quint32>(data) != FRAME_MAGIC || quint8(data[4]) != FRAME_VERSION) {
+        return false;
+    }
+
+    header.version = quint8(data[4]);
+    header.flags = quint8(data[5]);
+    header.type = qFromBigEndian<quint16>(data + 6);
+    header.requestId = qFromBigEndian<quint32>(data + 8);
+    header.length = qFromBigEndian<quint64>(data + 12);
+    return true;
+}
+
+// Level 1 keeps up with the link. False, and nothing to send compressed, unless the
+// payload shrinks by at least an eighth.
+inline bool compressPayload(const char* data, int size, QByteArray& out) {
+    if (size < COMPRESS_MIN_SIZE) {
+        return false;
+    }
+
+    out = qCompress(reinterpret_cast<const uchar*>(data), size, 1);
+    return out.size() < size - size / 8;
+}
+
+// Decides from the first few KiB whether a stream is worth compressing at all, so
+// already-compressed media goes out untouched.
+inline bool worthCompressing(const char* data, int size) {
+    QByteArray sample;
+    return compressPayload(data, qMin(size, COMPRESS_SAMPLE_SIZE), sample);
+}
+
+// False on a corrupt payload or one claiming to inflate beyond maxSize.
+inline bool uncompressPayload(const QByteArray& data, qint64 maxSize, QByteArray& out) {
+    if (data.size() < 4) {
+        return false;
+    }
+
+    quint32 size = qFromBigEndian<quint32>(data.constData());
+    if (size > maxSize) {
+        return false;
+    }
+
+    out = qUncompress(data);
+    return out.size() == int(size);
+}
+
+// Delta uploads: the server lists weak and strong checksums of the stored file's blocks,
+// the client answers with ops, each a byte and a big-endian quint32: copy block n of the
+// stored file, or n literal bytes that follow the op.
+static const char DELTA_COPY = 'C';
+static const char DELTA_LITERAL = 'L';
+static const int DELTA_OP_SIZE = 5;
+static const int DELTA_STRONG_SIZE = 16;
+
+// rsync's rolling checksum: a is the byte sum, b the sum weighted by distance to the end.
+inline void weakChecksum(const char* data, int size, quint32& a, quint32& b) {
+    a = 0;
+    b = 0;
+    for (int i = 0; i < size; i++) {
+        a += uchar(data[i]);
+        b += quint32(size - i) * uchar(data[i]);
+    }
+}
+
+inline quint32 weakDigest(quint32 a, quint32 b) {
+    return (a & 0xffff) | (b << 16);
+}
+
+inline QByteArray strongChecksum(const char* data, int size) {
+    return QCryptographicHash::hash(QByteArray::fromRawData(data, size), QCryptographicHash::Sha256).left(DELTA_STRONG_SIZE);
+}
+
 #endif // !UTILS_H